@@ -22,6 +22,9 @@ ZEND_DECLARE_MODULE_GLOBALS(mincrypt)
 static function_entry mincrypt_functions[] = {
 	PHP_FE(mincrypt_set_password,NULL)
 	PHP_FE(mincrypt_set_encoding_type,NULL)
+	PHP_FE(mincrypt_set_chunk_size,NULL)
+	PHP_FE(mincrypt_set_stats,NULL)
+	PHP_FE(mincrypt_get_stats,NULL)
 	PHP_FE(mincrypt_get_last_error, NULL)
 	PHP_FE(mincrypt_reset_last_error, NULL)
 	PHP_FE(mincrypt_generate_keys, NULL)
@@ -89,6 +92,7 @@ PHP_MINIT_FUNCTION(mincrypt)
 	REGISTER_LONG_CONSTANT("MINCRYPT_ENCODING_TYPE_BASE64",	ENCODING_TYPE_BASE64,	CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("MINCRYPT_KEY_PRIVATE",		FLAG_KEY_PRIVATE,	CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("MINCRYPT_KEY_PUBLIC",		FLAG_KEY_PUBLIC,	CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("MINCRYPT_CHUNK_SIZE_AUTO",	CHUNK_SIZE_AUTO,	CONST_CS | CONST_PERSISTENT);
 
 	return SUCCESS;
 }
@@ -263,6 +267,71 @@ PHP_FUNCTION(mincrypt_set_encoding_type)
 	RETURN_TRUE;
 }
 
+/*
+	Function name:		mincrypt_set_chunk_size
+	Since version:		0.0.5
+	Description:		Function to set the size of the chunks of the files encrypted using mincrypt_encrypt_file(). Smaller chunks need less memory per request, bigger chunks are faster for big files
+	Arguments:		@size [int]: chunk size in bytes, MINCRYPT_CHUNK_SIZE_AUTO to pick the fastest chunk size for this machine
+	Returns:		TRUE if success, FALSE if error. You can get the error using mincrypt_get_last_error() call
+*/
+PHP_FUNCTION(mincrypt_set_chunk_size)
+{
+	long size = -1;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "l", &size) == FAILURE)
+		RETURN_FALSE;
+
+	if ((size < 0) || (mincrypt_set_chunk_size((size_t)size) != 0)) {
+		set_error("Invalid chunk size");
+		RETURN_FALSE;
+	}
+
+	RETURN_TRUE;
+}
+
+/*
+	Function name:		mincrypt_set_stats
+	Since version:		0.0.5
+	Description:		Function to enable or disable collection of the runtime statistics returned by mincrypt_get_stats(). Enabling resets the statistics
+	Arguments:		@enable [bool]: TRUE to enable the statistics, FALSE to disable them
+	Returns:		TRUE if success, FALSE if error
+*/
+PHP_FUNCTION(mincrypt_set_stats)
+{
+	zend_bool enable = 1;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|b", &enable) == FAILURE)
+		RETURN_FALSE;
+
+	mincrypt_set_stats(enable ? 1 : 0);
+	RETURN_TRUE;
+}
+
+/*
+	Function name:		mincrypt_get_stats
+	Since version:		0.0.5
+	Description:		Function to get the runtime statistics collected since mincrypt_set_stats() call. Time is summed up over all the threads
+	Arguments:		None
+	Returns:		array with bytes_in, bytes_out, chunks, crc_failures, allocations, ns_crc, ns_cipher, ns_base64 and ns_io keys
+*/
+PHP_FUNCTION(mincrypt_get_stats)
+{
+	mincrypt_stats_t stats;
+
+	mincrypt_get_stats(&stats);
+
+	array_init(return_value);
+	add_assoc_long(return_value, "bytes_in", (long)stats.bytes_in);
+	add_assoc_long(return_value, "bytes_out", (long)stats.bytes_out);
+	add_assoc_long(return_value, "chunks", (long)stats.chunks);
+	add_assoc_long(return_value, "crc_failures", (long)stats.crc_failures);
+	add_assoc_long(return_value, "allocations", (long)stats.allocations);
+	add_assoc_long(return_value, "ns_crc", (long)stats.ns_crc);
+	add_assoc_long(return_value, "ns_cipher", (long)stats.ns_cipher);
+	add_assoc_long(return_value, "ns_base64", (long)stats.ns_base64);
+	add_assoc_long(return_value, "ns_io", (long)stats.ns_io);
+}
+
 /*
 	Function name:		mincrypt_encrypt
 	Since version:		0.0.1
@@ -357,9 +426,9 @@ PHP_FUNCTION(mincrypt_decrypt)
 	}
 
 	if (flags & ENCODING_TYPE_BASE64)
-		block_out = (unsigned char *)mincrypt_decrypt((unsigned char *)tmp, rc - 1, next_id(0), &rc, NULL);
+		block_out = (unsigned char *)mincrypt_decrypt((unsigned char *)tmp, rc, next_id(0), &rc, NULL);
 	else {
-		block_out = (unsigned char *)mincrypt_decrypt((unsigned char *)block, block_size - 1, next_id(0), &rc, NULL);
+		block_out = (unsigned char *)mincrypt_decrypt((unsigned char *)block, block_size, next_id(0), &rc, NULL);
 		rc--;
 	}
 
@@ -48,6 +48,9 @@ PHP_FUNCTION(mincrypt_set_password);
 PHP_FUNCTION(mincrypt_generate_keys);
 PHP_FUNCTION(mincrypt_read_key);
 PHP_FUNCTION(mincrypt_set_encoding_type);
+PHP_FUNCTION(mincrypt_set_chunk_size);
+PHP_FUNCTION(mincrypt_set_stats);
+PHP_FUNCTION(mincrypt_get_stats);
 PHP_FUNCTION(mincrypt_get_last_error);
 PHP_FUNCTION(mincrypt_reset_last_error);
 PHP_FUNCTION(mincrypt_reset_id);
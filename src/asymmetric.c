@@ -26,7 +26,8 @@ do { fprintf(stderr, "[mincrypt/asymmetric  ] " fmt , ##args); } while (0)
 
 uint64_t get_decryption_value(uint64_t p, uint64_t q, uint64_t e, uint64_t *on)
 {
-	uint64_t n, eu, d, i;
+	uint64_t n, eu, d, r0, r1, q0;
+	int64_t t0, t1, tmp;
 
 	n = p * q;
 	eu = (p - 1) * (q - 1);
@@ -34,14 +35,29 @@ uint64_t get_decryption_value(uint64_t p, uint64_t q, uint64_t e, uint64_t *on)
 	DPRINTF("%s: p = %"PRIu64", q = %"PRIu64", n = %"PRIu64", eu = %"PRIu64"\n",
 			__FUNCTION__, p, q, n, eu);
 
+	/* Extended Euclidean algorithm, only the coefficient of e is tracked */
 	d = 0;
-	if (e > 0) {
-		for (i = 0; i < (int)n; i++) {
-			if ((i * (int)e) % eu == 1.) {
-				d = i;
-				break;
-			}
+	if ((e > 0) && (eu > 1)) {
+		t0 = 0;
+		t1 = 1;
+		r0 = eu;
+		r1 = e % eu;
+
+		while (r1 != 0) {
+			q0 = r0 / r1;
+
+			tmp = t0 - (int64_t)q0 * t1;
+			t0 = t1;
+			t1 = tmp;
+
+			tmp = r0 - q0 * r1;
+			r0 = r1;
+			r1 = tmp;
 		}
+
+		/* Inverse exists only if gcd(e, eu) == 1 */
+		if (r0 == 1)
+			d = (t0 < 0) ? (uint64_t)(t0 + (int64_t)eu) : (uint64_t)t0;
 	}
 
 	if (on != NULL)
@@ -115,10 +131,46 @@ int get_random_values(uint64_t seed, int size, uint64_t *p, uint64_t *q, uint64_
 	return 0;
 }
 
+/* Odd primes used to filter out candidates before running Miller-Rabin test */
+static const uint64_t small_primes[] = { 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47 };
+
+/* Witnesses making Miller-Rabin test deterministic for all 64-bit numbers */
+static const uint64_t mr_bases[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+
+/*
+	Private function name:	miller_rabin_witness
+	Since version:		0.0.5
+	Description:		This function is used to run single round of Miller-Rabin test of odd number for the base
+	Arguments:		@number [uint64_t]: odd number to be tested
+				@base [uint64_t]: witness base, smaller than number
+				@d [uint64_t]: odd part of number - 1
+				@s [int]: number of trailing zero bits of number - 1
+	Returns:		1 if number is probable prime for the base, 0 if base proves number to be composite
+*/
+static int miller_rabin_witness(uint64_t number, uint64_t base, uint64_t d, int s)
+{
+	uint64_t x;
+	int i;
+
+	x = pow_and_mod(base, d, number);
+	if ((x == 1) || (x == number - 1))
+		return 1;
+
+	for (i = 1; i < s; i++) {
+		x = pow_and_mod(x, 2, number);
+		if (x == number - 1)
+			return 1;
+		if (x == 1)
+			return 0;
+	}
+
+	return 0;
+}
+
 int check_is_prime_number_since(uint64_t start, uint64_t number)
 {
-	int i = 0;
-	uint64_t tmp;
+	int i, s;
+	uint64_t tmp, d;
 
 	if (number <= 0)
 		return -1;
@@ -127,18 +179,40 @@ int check_is_prime_number_since(uint64_t start, uint64_t number)
 	if (number % 2 == 0)
 		return 0;
 
-	for (tmp = start; tmp < number; tmp += 2) {
-		/* If we've passed square root then it must be prime number */
-		if ((uint64_t)pow(tmp, 2) > number)
-			break;
-
-		if (number % tmp == 0) {
-			i++;
-			break;
+	/* Skipping divisors smaller than start is only possible using trial division */
+	if (start != 3) {
+		for (tmp = start; (tmp < number) && (tmp <= number / tmp); tmp += 2) {
+			if (number % tmp == 0)
+				return 0;
 		}
+
+		return 1;
 	}
 
-	return (i == 0);
+	for (i = 0; i < sizeof(small_primes) / sizeof(small_primes[0]); i++) {
+		if (number == small_primes[i])
+			return 1;
+		if (number % small_primes[i] == 0)
+			return 0;
+	}
+
+	/* No factor up to the square root, number 1 is treated as prime as well */
+	if (number < 53 * 53)
+		return 1;
+
+	d = number - 1;
+	s = 0;
+	while ((d & 1) == 0) {
+		d >>= 1;
+		s++;
+	}
+
+	for (i = 0; i < sizeof(mr_bases) / sizeof(mr_bases[0]); i++) {
+		if (!miller_rabin_witness(number, mr_bases[i], d, s))
+			return 0;
+	}
+
+	return 1;
 }
 
 int check_is_prime_number(uint64_t number)
@@ -195,7 +269,12 @@ uint64_t find_nearest_prime_number(uint64_t number, int flags)
 	uint64_t i;
 
 	if (flags == GET_NEAREST_BIGGER) {
-		for (i = number; i < (uint64_t)-1; i++) {
+		/* Zero is reported as -1 which is taken as match */
+		if (number == 0)
+			return 0;
+
+		/* Even numbers are never reported as prime so walk odd candidates only */
+		for (i = number | 1; i >= number; i += 2) {
 			if (check_is_prime_number(i))
 				return i;
 		}
@@ -204,7 +283,8 @@ uint64_t find_nearest_prime_number(uint64_t number, int flags)
 	}
 	else
 	if (flags == GET_NEAREST_SMALLER) {
-		for (i = number; i > 0; i--) {
+		/* Walk terminates at latest on number 1 reported as prime */
+		for (i = (number % 2) ? number : number - 1; (i > 0) && (i <= number); i -= 2) {
 			if (check_is_prime_number(i))
 				return i;
 		}
@@ -173,18 +173,141 @@ char *dec_to_hex(int dec)
 	return strdup(buf);
 }
 
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 uint128_t;
+
+/*
+	Private function name:	mulmod
+	Since version:		0.0.5
+	Description:		This function is used to multiply two residues modulo mod using 128-bit intermediate product so the multiplication cannot overflow
+	Arguments:		@a [uint64_t]: first residue
+				@b [uint64_t]: second residue
+				@mod [uint64_t]: modulus
+	Returns:		a * b modulo mod
+*/
+static inline uint64_t mulmod(uint64_t a, uint64_t b, uint64_t mod)
+{
+	return (uint64_t)(((uint128_t)a * b) % mod);
+}
+
+/*
+	Private function name:	montgomery_reduce
+	Since version:		0.0.5
+	Description:		This function is used to perform Montgomery reduction (REDC) of the product with R = 2^64. Modulus has to be odd and smaller than 2^63 so the intermediate sum fits into 128 bits
+	Arguments:		@t [uint128_t]: value to reduce, smaller than mod * R
+				@mod [uint64_t]: modulus
+				@ninv [uint64_t]: negated inverse of modulus modulo R
+	Returns:		t / R modulo mod
+*/
+static inline uint64_t montgomery_reduce(uint128_t t, uint64_t mod, uint64_t ninv)
+{
+	uint64_t m = (uint64_t)t * ninv;
+	uint64_t r = (uint64_t)((t + (uint128_t)m * mod) >> 64);
+
+	return (r >= mod) ? r - mod : r;
+}
+
+/*
+	Private function name:	pow_and_mod_montgomery
+	Since version:		0.0.5
+	Description:		This function is used to compute modular exponentiation in Montgomery form. The division is only needed for converting the base and one into Montgomery form, all the multiplications by the square-and-multiply loop are reduced by REDC
+	Arguments:		@n [uint64_t]: base, already reduced modulo mod
+				@e [uint64_t]: exponent
+				@mod [uint64_t]: odd modulus smaller than 2^63
+	Returns:		n^e modulo mod
+*/
+static uint64_t pow_and_mod_montgomery(uint64_t n, uint64_t e, uint64_t mod)
+{
+	uint64_t ninv, base, val;
+	int i;
+
+	/* Newton iteration doubles the number of correct low bits, mod * mod == 1 (mod 8) gives first 3 */
+	ninv = mod;
+	for (i = 0; i < 5; i++)
+		ninv *= 2 - mod * ninv;
+	ninv = -ninv;
+
+	base = (uint64_t)(((uint128_t)n << 64) % mod);
+	val = (uint64_t)(((uint128_t)1 << 64) % mod);
+
+	while (e > 0) {
+		if (e & 1)
+			val = montgomery_reduce((uint128_t)val * base, mod, ninv);
+		e >>= 1;
+		if (e > 0)
+			base = montgomery_reduce((uint128_t)base * base, mod, ninv);
+	}
+
+	return montgomery_reduce(val, mod, ninv);
+}
+#else
+/*
+	Private function name:	mulmod
+	Since version:		0.0.5
+	Description:		This function is used to multiply two residues modulo mod by doubling and adding so the multiplication cannot overflow on platforms without 128-bit integer type
+	Arguments:		@a [uint64_t]: first residue
+				@b [uint64_t]: second residue
+				@mod [uint64_t]: modulus
+	Returns:		a * b modulo mod
+*/
+static uint64_t mulmod(uint64_t a, uint64_t b, uint64_t mod)
+{
+	uint64_t ret = 0;
+
+	while (b > 0) {
+		if (b & 1)
+			ret = (ret >= mod - a) ? ret - (mod - a) : ret + a;
+		b >>= 1;
+		if (b > 0)
+			a = (a >= mod - a) ? a - (mod - a) : a + a;
+	}
+
+	return ret;
+}
+#endif
+
+/*
+	Function name:		pow_and_mod
+	Since version:		0.0.1
+	Description:		This function is used to compute n^e modulo mod using binary (square-and-multiply) exponentiation. Moduli up to 32 bits use native 64-bit products, bigger odd moduli use Montgomery multiplication and the rest uses 128-bit intermediate products
+	Arguments:		@n [uint64_t]: base
+				@e [uint64_t]: exponent
+				@mod [uint64_t]: modulus
+	Returns:		n^e modulo mod, 0 for modulus smaller than 2
+*/
 uint64_t pow_and_mod(uint64_t n, uint64_t e, uint64_t mod)
 {
-	uint64_t i;
-	uint64_t val = n;
+	uint64_t val = 1;
+
+	if (mod < 2)
+		return 0;
 
-	for (i = 1; i < e; i++) {
-		val *= n;
+	n %= mod;
 
-		if (val > mod)
-			val %= mod;
+	if (mod <= UINT32_MAX) {
+		while (e > 0) {
+			if (e & 1)
+				val = (val * n) % mod;
+			e >>= 1;
+			if (e > 0)
+				n = (n * n) % mod;
+		}
+
+		return val;
+	}
+
+#ifdef __SIZEOF_INT128__
+	if ((mod & 1) && (mod < (1ULL << 63)))
+		return pow_and_mod_montgomery(n, e, mod);
+#endif
+
+	while (e > 0) {
+		if (e & 1)
+			val = mulmod(val, n, mod);
+		e >>= 1;
+		if (e > 0)
+			n = mulmod(n, n, mod);
 	}
 
 	return val;
 }
-
@@ -0,0 +1,446 @@
+/*
+ *  cipher.c: Data block transformation kernels with runtime CPU feature dispatch
+ *
+ *  Copyright (c) 2010-2011, Michal Novotny <mignov@gmail.com>
+ *  All rights reserved.
+ *
+ *  See COPYING for the license of this software
+ *
+ */
+
+#include "mincrypt.h"
+
+#ifndef WINDOWS
+#include <pthread.h>
+#endif
+
+#ifndef DISABLE_DEBUG
+#define DEBUG_CIPHER
+#endif
+
+#ifdef DEBUG_CIPHER
+#define DPRINTF(fmt, ...) \
+do { fprintf(stderr, "[mincrypt/cipher      ] " fmt , ## __VA_ARGS__); } while (0)
+#else
+#define DPRINTF(fmt, ...) \
+do {} while(0)
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Kernels selected together so that the dispatch is switched by a single pointer store */
+typedef struct tCipherKernels {
+	int kernel;
+	tCipherKernel sub;
+	tCipherKernel add;
+} tCipherKernels;
+
+static const tCipherKernels *cipher_kernels = NULL;
+
+#ifndef WINDOWS
+static pthread_once_t cipher_once = PTHREAD_ONCE_INIT;
+#endif
+
+/*
+	Private function name:	cipher_sub_scalar
+	Since version:		0.0.5
+	Description:		Scalar kernel computing out[i] = ks[i] - in[i] one byte at a time
+	Arguments:		@out [buffer]: output buffer, may be identical to in
+				@ks [buffer]: key stream bytes
+				@in [buffer]: input bytes
+				@len [size_t]: number of bytes to process
+	Returns:		None
+*/
+static void cipher_sub_scalar(unsigned char *out, const unsigned char *ks, const unsigned char *in, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		out[i] = ks[i] - in[i];
+}
+
+/*
+	Private function name:	cipher_add_scalar
+	Since version:		0.0.5
+	Description:		Scalar kernel computing out[i] = ks[i] + in[i] one byte at a time
+	Arguments:		@out [buffer]: output buffer, may be identical to in
+				@ks [buffer]: key stream bytes
+				@in [buffer]: input bytes
+				@len [size_t]: number of bytes to process
+	Returns:		None
+*/
+static void cipher_add_scalar(unsigned char *out, const unsigned char *ks, const unsigned char *in, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		out[i] = ks[i] + in[i];
+}
+
+#ifdef HAVE_X86_SIMD
+/*
+	Private function name:	cipher_sub_sse2
+	Since version:		0.0.5
+	Description:		SSE2 kernel computing out[i] = ks[i] - in[i] on 16 bytes per step
+	Arguments:		@out [buffer]: output buffer, may be identical to in
+				@ks [buffer]: key stream bytes
+				@in [buffer]: input bytes
+				@len [size_t]: number of bytes to process
+	Returns:		None
+*/
+__attribute__((target("sse2")))
+static void cipher_sub_sse2(unsigned char *out, const unsigned char *ks, const unsigned char *in, size_t len)
+{
+	__m128i k, d;
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		k = _mm_loadu_si128((const __m128i *)(ks + i));
+		d = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_sub_epi8(k, d));
+	}
+
+	cipher_sub_scalar(out + i, ks + i, in + i, len - i);
+}
+
+/*
+	Private function name:	cipher_add_sse2
+	Since version:		0.0.5
+	Description:		SSE2 kernel computing out[i] = ks[i] + in[i] on 16 bytes per step
+	Arguments:		@out [buffer]: output buffer, may be identical to in
+				@ks [buffer]: key stream bytes
+				@in [buffer]: input bytes
+				@len [size_t]: number of bytes to process
+	Returns:		None
+*/
+__attribute__((target("sse2")))
+static void cipher_add_sse2(unsigned char *out, const unsigned char *ks, const unsigned char *in, size_t len)
+{
+	__m128i k, d;
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		k = _mm_loadu_si128((const __m128i *)(ks + i));
+		d = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_add_epi8(k, d));
+	}
+
+	cipher_add_scalar(out + i, ks + i, in + i, len - i);
+}
+
+/*
+	Private function name:	cipher_sub_avx2
+	Since version:		0.0.5
+	Description:		AVX2 kernel computing out[i] = ks[i] - in[i] on 32 bytes per step
+	Arguments:		@out [buffer]: output buffer, may be identical to in
+				@ks [buffer]: key stream bytes
+				@in [buffer]: input bytes
+				@len [size_t]: number of bytes to process
+	Returns:		None
+*/
+__attribute__((target("avx2")))
+static void cipher_sub_avx2(unsigned char *out, const unsigned char *ks, const unsigned char *in, size_t len)
+{
+	__m256i k, d;
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		k = _mm256_loadu_si256((const __m256i *)(ks + i));
+		d = _mm256_loadu_si256((const __m256i *)(in + i));
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_sub_epi8(k, d));
+	}
+
+	cipher_sub_scalar(out + i, ks + i, in + i, len - i);
+}
+
+/*
+	Private function name:	cipher_add_avx2
+	Since version:		0.0.5
+	Description:		AVX2 kernel computing out[i] = ks[i] + in[i] on 32 bytes per step
+	Arguments:		@out [buffer]: output buffer, may be identical to in
+				@ks [buffer]: key stream bytes
+				@in [buffer]: input bytes
+				@len [size_t]: number of bytes to process
+	Returns:		None
+*/
+__attribute__((target("avx2")))
+static void cipher_add_avx2(unsigned char *out, const unsigned char *ks, const unsigned char *in, size_t len)
+{
+	__m256i k, d;
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		k = _mm256_loadu_si256((const __m256i *)(ks + i));
+		d = _mm256_loadu_si256((const __m256i *)(in + i));
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_add_epi8(k, d));
+	}
+
+	cipher_add_scalar(out + i, ks + i, in + i, len - i);
+}
+#endif
+
+static const tCipherKernels cipher_kernels_scalar = { CIPHER_KERNEL_SCALAR, cipher_sub_scalar, cipher_add_scalar };
+#ifdef HAVE_X86_SIMD
+static const tCipherKernels cipher_kernels_sse2 = { CIPHER_KERNEL_SSE2, cipher_sub_sse2, cipher_add_sse2 };
+static const tCipherKernels cipher_kernels_avx2 = { CIPHER_KERNEL_AVX2, cipher_sub_avx2, cipher_add_avx2 };
+#endif
+
+/*
+	Private function name:	cipher_select_kernels
+	Since version:		0.0.5
+	Description:		This function is used to get the kernels for the kernel type. CIPHER_KERNEL_AUTO selects the best kernel supported by the CPU
+	Arguments:		@kernel [int]: one of CIPHER_KERNEL_AUTO, CIPHER_KERNEL_SCALAR, CIPHER_KERNEL_SSE2 or CIPHER_KERNEL_AVX2
+	Returns:		kernels, NULL if the kernel is not supported by this CPU
+*/
+static const tCipherKernels *cipher_select_kernels(int kernel)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+
+	if (kernel == CIPHER_KERNEL_AUTO)
+		kernel = __builtin_cpu_supports("avx2") ? CIPHER_KERNEL_AVX2 :
+			(__builtin_cpu_supports("sse2") ? CIPHER_KERNEL_SSE2 : CIPHER_KERNEL_SCALAR);
+
+	if (((kernel == CIPHER_KERNEL_AVX2) && !__builtin_cpu_supports("avx2"))
+		|| ((kernel == CIPHER_KERNEL_SSE2) && !__builtin_cpu_supports("sse2")))
+		return NULL;
+
+	if (kernel == CIPHER_KERNEL_AVX2)
+		return &cipher_kernels_avx2;
+	if (kernel == CIPHER_KERNEL_SSE2)
+		return &cipher_kernels_sse2;
+#else
+	if (kernel == CIPHER_KERNEL_AUTO)
+		kernel = CIPHER_KERNEL_SCALAR;
+
+	if (kernel != CIPHER_KERNEL_SCALAR)
+		return NULL;
+#endif
+
+	return &cipher_kernels_scalar;
+}
+
+/*
+	Private function name:	cipher_init
+	Since version:		0.0.5
+	Description:		This function is used to select the best kernels supported by the CPU on the first use
+	Arguments:		None
+	Returns:		None
+*/
+static void cipher_init(void)
+{
+	const tCipherKernels *kernels = cipher_select_kernels(CIPHER_KERNEL_AUTO);
+
+	DPRINTF("%s: Using %s kernel\n", __FUNCTION__, (kernels->kernel == CIPHER_KERNEL_AVX2) ? "AVX2" :
+			((kernels->kernel == CIPHER_KERNEL_SSE2) ? "SSE2" : "scalar"));
+
+	__atomic_store_n(&cipher_kernels, kernels, __ATOMIC_RELEASE);
+}
+
+/*
+	Private function name:	cipher_get_kernels
+	Since version:		0.0.5
+	Description:		This function is used to get the kernels currently used, the kernels are selected once by cipher_init() even if several threads use them for the first time at once
+	Arguments:		None
+	Returns:		kernels
+*/
+static const tCipherKernels *cipher_get_kernels(void)
+{
+#ifndef WINDOWS
+	pthread_once(&cipher_once, cipher_init);
+#else
+	if (cipher_kernels == NULL)
+		cipher_init();
+#endif
+
+	return __atomic_load_n(&cipher_kernels, __ATOMIC_ACQUIRE);
+}
+
+/*
+	Function name:		cipher_set_kernel
+	Since version:		0.0.5
+	Description:		This function is used to select the kernel used for the data transformation. CIPHER_KERNEL_AUTO selects the best kernel supported by the CPU
+	Arguments:		@kernel [int]: one of CIPHER_KERNEL_AUTO, CIPHER_KERNEL_SCALAR, CIPHER_KERNEL_SSE2 or CIPHER_KERNEL_AVX2
+	Returns:		0 on success, -ENOTSUP if the kernel is not supported by this CPU
+*/
+int cipher_set_kernel(int kernel)
+{
+	const tCipherKernels *kernels;
+
+	if ((kernels = cipher_select_kernels(kernel)) == NULL)
+		return -ENOTSUP;
+
+	/* Run the lazy selection first so it cannot override this one later */
+	cipher_get_kernels();
+
+	DPRINTF("%s: Using %s kernel\n", __FUNCTION__, (kernels->kernel == CIPHER_KERNEL_AVX2) ? "AVX2" :
+			((kernels->kernel == CIPHER_KERNEL_SSE2) ? "SSE2" : "scalar"));
+
+	__atomic_store_n(&cipher_kernels, kernels, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*
+	Function name:		cipher_get_kernel
+	Since version:		0.0.5
+	Description:		This function is used to get the kernel used for the data transformation
+	Arguments:		None
+	Returns:		one of CIPHER_KERNEL_SCALAR, CIPHER_KERNEL_SSE2 or CIPHER_KERNEL_AVX2
+*/
+int cipher_get_kernel(void)
+{
+	return cipher_get_kernels()->kernel;
+}
+
+/*
+ * Key stream fillers computing ks[i] = c0 - v or ks[i] = c0 + v where v is the lowest byte of
+ * (iv[(off + i) % vector_size] << ((shift + off + i) & 31)). The power of two variants replace
+ * the modulo by mask, the generic ones keep the running vector index instead of dividing.
+ */
+static void cipher_fill_sub_pow2(cipher_key_t *key, unsigned char *ks, int off, int len)
+{
+	const uint32_t *iv = key->ctx->iv;
+	uint32_t mask = key->ctx->vector_size - 1;
+	uint32_t shift = key->shift + off;
+	int i;
+
+	for (i = 0; i < len; i++)
+		ks[i] = key->c0 - (unsigned char)(iv[(off + i) & mask] << ((shift + i) & 31));
+}
+
+static void cipher_fill_add_pow2(cipher_key_t *key, unsigned char *ks, int off, int len)
+{
+	const uint32_t *iv = key->ctx->iv;
+	uint32_t mask = key->ctx->vector_size - 1;
+	uint32_t shift = key->shift + off;
+	int i;
+
+	for (i = 0; i < len; i++)
+		ks[i] = key->c0 + (unsigned char)(iv[(off + i) & mask] << ((shift + i) & 31));
+}
+
+static void cipher_fill_sub(cipher_key_t *key, unsigned char *ks, int off, int len)
+{
+	const uint32_t *iv = key->ctx->iv;
+	int vs = key->ctx->vector_size;
+	uint32_t shift = key->shift + off;
+	int i, j, n;
+
+	for (i = 0, j = off % vs; i < len; j = 0) {
+		n = (len - i < vs - j) ? len - i : vs - j;
+		for (; n > 0; n--, i++, j++)
+			ks[i] = key->c0 - (unsigned char)(iv[j] << ((shift + i) & 31));
+	}
+}
+
+static void cipher_fill_add(cipher_key_t *key, unsigned char *ks, int off, int len)
+{
+	const uint32_t *iv = key->ctx->iv;
+	int vs = key->ctx->vector_size;
+	uint32_t shift = key->shift + off;
+	int i, j, n;
+
+	for (i = 0, j = off % vs; i < len; j = 0) {
+		n = (len - i < vs - j) ? len - i : vs - j;
+		for (; n > 0; n--, i++, j++)
+			ks[i] = key->c0 + (unsigned char)(iv[j] << ((shift + i) & 31));
+	}
+}
+
+/*
+	Function name:		cipher_key_init
+	Since version:		0.0.5
+	Description:		This function is used to prepare the key stream for the chunk and to select the kernels for the mode. With K[i] = (ival - crc - (iv[i % vector_size] << ((id * size) + i))) the modes are computed as:
+				symmetric encryption and decryption: out = K - in (the transformation is an involution)
+				asymmetric encryption: out = shiftByte - (K - in) = (shiftByte - K) + in
+				asymmetric decryption: out = K - (shiftByte - in) = (K - shiftByte) + in
+				so each mode is a single subtraction or addition of its own key stream. Since only the lowest byte is kept, the key stream repeats with the period of lcm(vector_size, 32) bytes. It's generated once for the period and stored twice in a row so that any window of one period is contiguous. If the period doesn't fit, the key stream is generated for each part of the data right before it's used
+	Arguments:		@key [key]: key stream to be initialized
+				@ctx [context]: context holding the initialization vectors
+				@size [int]: size of the whole chunk
+				@crc [uint32_t]: CRC value for the data block
+				@id [int]: identifier of the chunk
+				@mode [int]: one of CIPHER_MODE_SYMMETRIC_ENCRYPT, CIPHER_MODE_SYMMETRIC_DECRYPT, CIPHER_MODE_ASYMMETRIC_ENCRYPT or CIPHER_MODE_ASYMMETRIC_DECRYPT
+				@shiftByte [unsigned char]: asymmetric shift byte, ignored for symmetric modes
+	Returns:		None
+*/
+void cipher_key_init(cipher_key_t *key, mincrypt_ctx_t *ctx, int size, uint32_t crc, int id, int mode, unsigned char shiftByte)
+{
+	const tCipherKernels *kernels = cipher_get_kernels();
+	unsigned char base;
+	int vs, period, pow2;
+
+	vs = ctx->vector_size;
+	pow2 = ((vs & (vs - 1)) == 0);
+	base = (unsigned char)(ctx->ival - crc);
+
+	key->ctx = ctx;
+	/* Shift count is taken modulo 32 the same way as x86 does for 32-bit shifts */
+	key->shift = (uint32_t)id * (uint32_t)size;
+
+	if (mode == CIPHER_MODE_ASYMMETRIC_ENCRYPT) {
+		key->c0 = shiftByte - base;
+		key->fill = pow2 ? cipher_fill_add_pow2 : cipher_fill_add;
+		key->kernel = kernels->add;
+	}
+	else
+	if (mode == CIPHER_MODE_ASYMMETRIC_DECRYPT) {
+		key->c0 = base - shiftByte;
+		key->fill = pow2 ? cipher_fill_sub_pow2 : cipher_fill_sub;
+		key->kernel = kernels->add;
+	}
+	else {
+		key->c0 = base;
+		key->fill = pow2 ? cipher_fill_sub_pow2 : cipher_fill_sub;
+		key->kernel = kernels->sub;
+	}
+
+	/* Period of the key stream is lcm(vector_size, 32) */
+	period = pow2 ? ((vs > 32) ? vs : 32) : vs;
+	while (period % 32 != 0)
+		period += vs;
+
+	if (period > CIPHER_PERIOD_MAX) {
+		key->period = 0;
+		return;
+	}
+
+	key->fill(key, key->ks, 0, period);
+	memcpy(key->ks + period, key->ks, period);
+	key->period = period;
+}
+
+/*
+	Function name:		cipher_key_apply
+	Since version:		0.0.5
+	Description:		This function is used to apply the transformation selected by cipher_key_init() to the part of the chunk starting at offset off. The output is byte-identical to processing the whole chunk at once
+	Arguments:		@key [key]: key stream of the chunk
+				@out [buffer]: output buffer, may be identical to in
+				@in [buffer]: input buffer
+				@off [int]: offset of the first byte within the chunk
+				@len [int]: number of bytes to process
+	Returns:		None
+*/
+void cipher_key_apply(cipher_key_t *key, unsigned char *out, const unsigned char *in, int off, int len)
+{
+	const unsigned char *ks;
+	int i, n;
+
+	if (key->period == 0) {
+		for (i = 0; i < len; i += n) {
+			n = (len - i < CIPHER_PERIOD_MAX) ? len - i : CIPHER_PERIOD_MAX;
+			key->fill(key, key->ks, off + i, n);
+			key->kernel(out + i, key->ks, in + i, n);
+		}
+		return;
+	}
+
+	ks = key->ks + (off % key->period);
+	for (i = 0; i < len; i += n) {
+		n = (len - i < key->period) ? len - i : key->period;
+		key->kernel(out + i, ks, in + i, n);
+	}
+}
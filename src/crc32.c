@@ -10,6 +10,10 @@
 
 #include "mincrypt.h"
 
+#ifndef WINDOWS
+#include <pthread.h>
+#endif
+
 //#define TEST_CRC
 
 #ifndef DISABLE_DEBUG
@@ -23,10 +27,39 @@ do { fprintf(stderr, "[mincrypt/crc32       ] " fmt , ##args); } while (0)
 #define DPRINTF(fmt, args...) do {} while(0)
 #endif
 
-uint32_t crc_tab[256];
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Size of the buffer used to read files */
+#define CRC_FILE_CHUNK_SIZE	(1 << 20)
+
+/* Number of times the test buffer is checksummed when selecting the implementation */
+#define CRC_BENCH_ROUNDS	16
+
+typedef uint32_t (*tCrcFunc)(const unsigned char *block, uint32_t length, uint32_t crc);
+
+/* Table crc_tab_slice[k][i] holds CRC of byte i followed by k zero bytes */
+static uint32_t crc_tab_slice[16][256];
+uint32_t *crc_tab = crc_tab_slice[0];
 int crc_haveTab = 0;
 
-void crc32_gentab()
+static int crc_impl = CRC32_IMPL_AUTO;
+static tCrcFunc crc_func = NULL;
+
+#ifndef WINDOWS
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+#endif
+
+/*
+	Private function name:	crc32_gentab_tables
+	Since version:		0.0.5
+	Description:		This function is used to generate the lookup tables of the table driven implementations
+	Arguments:		None
+	Returns:		None
+*/
+static void crc32_gentab_tables(void)
 {
 	unsigned long crc, poly;
 	int i, j;
@@ -47,24 +80,509 @@ void crc32_gentab()
 		crc_tab[i] = crc;
 	}
 
-	crc_haveTab = 1;
+	/* Tables for slicing are derived from the previous one by appending zero byte */
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 16; j++)
+			crc_tab_slice[j][i] = (crc_tab_slice[j - 1][i] >> 8) ^ crc_tab[crc_tab_slice[j - 1][i] & 0xFF];
 }
 
-uint32_t crc32_block(unsigned char *block, uint32_t length, uint64_t initVal)
+/* Little-endian load independent of the host byte order and alignment */
+#define GETUINT32LE(p)	((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | ((uint32_t)(p)[2] << 16) | ((uint32_t)(p)[3] << 24))
+
+static uint32_t crc32_bytewise(const unsigned char *block, uint32_t length, uint32_t crc)
 {
-	register unsigned long crc;
-	unsigned long i;
+	while (length--)
+		crc = (crc >> 8) ^ crc_tab[(crc ^ *block++) & 0xFF];
 
-	DPRINTF("Calculating CRC for 0x%" PRIx32 " bytes, init CRC value is 0x%" PRIx64 "\n", length, initVal);
+	return crc;
+}
+
+static uint32_t crc32_slice8(const unsigned char *block, uint32_t length, uint32_t crc)
+{
+	uint32_t one, two;
+
+	while (length >= 8) {
+		one = GETUINT32LE(block) ^ crc;
+		two = GETUINT32LE(block + 4);
+		crc = crc_tab_slice[7][one & 0xFF] ^ crc_tab_slice[6][(one >> 8) & 0xFF] ^
+			crc_tab_slice[5][(one >> 16) & 0xFF] ^ crc_tab_slice[4][one >> 24] ^
+			crc_tab_slice[3][two & 0xFF] ^ crc_tab_slice[2][(two >> 8) & 0xFF] ^
+			crc_tab_slice[1][(two >> 16) & 0xFF] ^ crc_tab_slice[0][two >> 24];
+
+		block += 8;
+		length -= 8;
+	}
+
+	return crc32_bytewise(block, length, crc);
+}
+
+static uint32_t crc32_slice16(const unsigned char *block, uint32_t length, uint32_t crc)
+{
+	uint32_t one, two, three, four;
+
+	while (length >= 16) {
+		one = GETUINT32LE(block) ^ crc;
+		two = GETUINT32LE(block + 4);
+		three = GETUINT32LE(block + 8);
+		four = GETUINT32LE(block + 12);
+		crc = crc_tab_slice[15][one & 0xFF] ^ crc_tab_slice[14][(one >> 8) & 0xFF] ^
+			crc_tab_slice[13][(one >> 16) & 0xFF] ^ crc_tab_slice[12][one >> 24] ^
+			crc_tab_slice[11][two & 0xFF] ^ crc_tab_slice[10][(two >> 8) & 0xFF] ^
+			crc_tab_slice[9][(two >> 16) & 0xFF] ^ crc_tab_slice[8][two >> 24] ^
+			crc_tab_slice[7][three & 0xFF] ^ crc_tab_slice[6][(three >> 8) & 0xFF] ^
+			crc_tab_slice[5][(three >> 16) & 0xFF] ^ crc_tab_slice[4][three >> 24] ^
+			crc_tab_slice[3][four & 0xFF] ^ crc_tab_slice[2][(four >> 8) & 0xFF] ^
+			crc_tab_slice[1][(four >> 16) & 0xFF] ^ crc_tab_slice[0][four >> 24];
+
+		block += 16;
+		length -= 16;
+	}
+
+	return crc32_bytewise(block, length, crc);
+}
+
+#ifdef HAVE_X86_SIMD
+/* Folding constants for the reflected 0xEDB88320 polynomial, x^(n) mod P(x) bit-reflected */
+static const uint64_t crc_k1k2[2] __attribute__((aligned(16))) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+static const uint64_t crc_k3k4[2] __attribute__((aligned(16))) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+static const uint64_t crc_k5k0[2] __attribute__((aligned(16))) = { 0x0163cd6124ULL, 0x0000000000ULL };
+/* Barrett reduction constants: P(x) and floor(x^64 / P(x)), both bit-reflected */
+static const uint64_t crc_poly[2] __attribute__((aligned(16))) = { 0x01db710641ULL, 0x01f7011641ULL };
+
+/*
+	Private function name:	crc32_pclmul
+	Since version:		0.0.5
+	Description:		This function is used to calculate CRC-32 using carry-less multiplication. Four 128-bit lanes are folded over 64 bytes per step, then folded into single lane and reduced to 32 bits by Barrett reduction. Blocks shorter than 64 bytes and the tail not multiple of 16 bytes are handled by the table implementation
+	Arguments:		@block [buffer]: data block
+				@length [uint32_t]: size of the data block
+				@crc [uint32_t]: initial CRC value
+	Returns:		CRC-32 value
+*/
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(const unsigned char *block, uint32_t length, uint32_t crc)
+{
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+	uint32_t tail;
+
+	if (length < 64)
+		return crc32_slice16(block, length, crc);
+
+	tail = length & 15;
+	length -= tail;
+
+	x1 = _mm_loadu_si128((const __m128i *)(block + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(block + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(block + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(block + 0x30));
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	x0 = _mm_load_si128((const __m128i *)crc_k1k2);
+
+	block += 64;
+	length -= 64;
+
+	/* Fold four lanes by 64 bytes */
+	while (length >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		y5 = _mm_loadu_si128((const __m128i *)(block + 0x00));
+		y6 = _mm_loadu_si128((const __m128i *)(block + 0x10));
+		y7 = _mm_loadu_si128((const __m128i *)(block + 0x20));
+		y8 = _mm_loadu_si128((const __m128i *)(block + 0x30));
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+		block += 64;
+		length -= 64;
+	}
+
+	/* Fold four lanes into one */
+	x0 = _mm_load_si128((const __m128i *)crc_k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* Fold the remaining 16-byte blocks */
+	while (length >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)block);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		block += 16;
+		length -= 16;
+	}
+
+	/* Fold 128 bits to 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((const __m128i *)crc_k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x0 = _mm_load_si128((const __m128i *)crc_poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
 
+	crc = (uint32_t)_mm_extract_epi32(x1, 1);
+
+	return crc32_slice16(block, tail, crc);
+}
+#endif
+
+static tCrcFunc crc32_get_func(int impl)
+{
+#ifdef HAVE_X86_SIMD
+	if (impl == CRC32_IMPL_PCLMUL)
+		return crc32_pclmul;
+#endif
+	if (impl == CRC32_IMPL_SLICE8)
+		return crc32_slice8;
+	if (impl == CRC32_IMPL_SLICE16)
+		return crc32_slice16;
+
+	return crc32_bytewise;
+}
+
+/*
+	Private function name:	crc32_have_pclmul
+	Since version:		0.0.5
+	Description:		This function is used to check whether the CPU supports instructions required by the carry-less multiplication implementation
+	Arguments:		None
+	Returns:		1 if supported, 0 otherwise
+*/
+static int crc32_have_pclmul(void)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#else
+	return 0;
+#endif
+}
+
+/*
+	Private function name:	crc32_bench
+	Since version:		0.0.5
+	Description:		This function is used to measure the time spent by the implementation on checksumming the test buffer
+	Arguments:		@impl [int]: implementation to be measured
+				@buf [buffer]: test buffer
+				@size [int]: size of the test buffer
+	Returns:		number of clock ticks spent
+*/
+static clock_t crc32_bench(int impl, unsigned char *buf, int size)
+{
+	tCrcFunc func = crc32_get_func(impl);
+	uint32_t crc = 0xFFFFFFFF;
+	clock_t start;
+	int i;
+
+	start = clock();
+	for (i = 0; i < CRC_BENCH_ROUNDS; i++)
+		crc = func(buf, size, crc);
+
+	/* Make sure the result is used so the loop is not optimized out */
+	buf[0] ^= (unsigned char)crc;
+
+	return clock() - start;
+}
+
+/*
+	Private function name:	crc32_select_auto
+	Since version:		0.0.5
+	Description:		This function is used to select the fastest implementation by a short benchmark, the lookup tables have to be generated already
+	Arguments:		None
+	Returns:		one of CRC32_IMPL_BYTEWISE, CRC32_IMPL_SLICE8, CRC32_IMPL_SLICE16 or CRC32_IMPL_PCLMUL
+*/
+static int crc32_select_auto(void)
+{
+	unsigned char buf[1 << 14];
+	clock_t t, best;
+	int i, impl;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = (unsigned char)(i * 31);
+
+	/* Prefer wider slicing unless it's measurably slower */
+	impl = CRC32_IMPL_SLICE16;
+	best = crc32_bench(impl, buf, sizeof(buf));
+	t = crc32_bench(CRC32_IMPL_SLICE8, buf, sizeof(buf));
+	if (t < best) {
+		impl = CRC32_IMPL_SLICE8;
+		best = t;
+	}
+	t = crc32_bench(CRC32_IMPL_BYTEWISE, buf, sizeof(buf));
+	if (t < best) {
+		impl = CRC32_IMPL_BYTEWISE;
+		best = t;
+	}
+	if (crc32_have_pclmul() && (crc32_bench(CRC32_IMPL_PCLMUL, buf, sizeof(buf)) <= best))
+		impl = CRC32_IMPL_PCLMUL;
+
+	return impl;
+}
+
+/*
+	Private function name:	crc32_publish_impl
+	Since version:		0.0.5
+	Description:		This function is used to switch the implementation used by crc32_block(). The function pointer is published by a release store so the threads loading it see the lookup tables generated before
+	Arguments:		@impl [int]: implementation to be used
+	Returns:		None
+*/
+static void crc32_publish_impl(int impl)
+{
+	DPRINTF("Using %s implementation\n", (impl == CRC32_IMPL_PCLMUL) ? "PCLMULQDQ" :
+			((impl == CRC32_IMPL_SLICE16) ? "slicing-by-16" :
+			((impl == CRC32_IMPL_SLICE8) ? "slicing-by-8" : "bytewise")));
+
+	__atomic_store_n(&crc_impl, impl, __ATOMIC_RELAXED);
+	__atomic_store_n(&crc_func, crc32_get_func(impl), __ATOMIC_RELEASE);
+}
+
+/*
+	Private function name:	crc32_init
+	Since version:		0.0.5
+	Description:		This function is used to generate the lookup tables and to select the fastest implementation on the first use. The flag of the generated tables is set only after the implementation is published so it's never set while there is no implementation to call
+	Arguments:		None
+	Returns:		None
+*/
+static void crc32_init(void)
+{
+	DPRINTF("Generating table\n");
+
+	crc32_gentab_tables();
+	crc32_publish_impl(crc32_select_auto());
+	__atomic_store_n(&crc_haveTab, 1, __ATOMIC_RELEASE);
+}
+
+/*
+	Function name:		crc32_gentab
+	Since version:		0.0.1
+	Description:		This function is used to generate the lookup tables and to select the implementation of the CRC-32 calculation. It's done only once even if called by several threads at the same time, the other threads wait until it's finished
+	Arguments:		None
+	Returns:		None
+*/
+void crc32_gentab(void)
+{
+#ifndef WINDOWS
+	pthread_once(&crc_once, crc32_init);
+#else
 	if (!crc_haveTab)
-		crc32_gentab();
+		crc32_init();
+#endif
+}
+
+/*
+	Function name:		crc32_set_impl
+	Since version:		0.0.5
+	Description:		This function is used to select the implementation of the CRC-32 calculation. CRC32_IMPL_AUTO selects the fastest one by a short benchmark, the carry-less multiplication one is considered only if the CPU supports PCLMULQDQ and SSE4.1 instructions. All implementations return identical values
+	Arguments:		@impl [int]: one of CRC32_IMPL_AUTO, CRC32_IMPL_BYTEWISE, CRC32_IMPL_SLICE8, CRC32_IMPL_SLICE16 or CRC32_IMPL_PCLMUL
+	Returns:		0 on success, -EINVAL for unknown implementation, -ENOTSUP if the implementation is not supported by this CPU
+*/
+int crc32_set_impl(int impl)
+{
+	if ((impl < CRC32_IMPL_AUTO) || (impl > CRC32_IMPL_PCLMUL))
+		return -EINVAL;
 
-	crc = initVal;
-	for (i = 0; i < length; i++)
-		crc = ((crc >> 8) & 0x00FFFFFF) ^ crc_tab[(crc ^ *block++) & 0xFF];
+	if ((impl == CRC32_IMPL_PCLMUL) && !crc32_have_pclmul())
+		return -ENOTSUP;
 
-	return crc;
+	/* Tables are needed by the benchmark, the first selection cannot override this one later either */
+	crc32_gentab();
+
+	if (impl == CRC32_IMPL_AUTO)
+		impl = crc32_select_auto();
+
+	crc32_publish_impl(impl);
+	return 0;
+}
+
+/*
+	Function name:		crc32_get_impl
+	Since version:		0.0.5
+	Description:		This function is used to get the implementation used for the CRC-32 calculation
+	Arguments:		None
+	Returns:		one of CRC32_IMPL_BYTEWISE, CRC32_IMPL_SLICE8, CRC32_IMPL_SLICE16 or CRC32_IMPL_PCLMUL
+*/
+int crc32_get_impl(void)
+{
+	crc32_gentab();
+
+	return __atomic_load_n(&crc_impl, __ATOMIC_RELAXED);
+}
+
+uint32_t crc32_block(unsigned char *block, uint32_t length, uint64_t initVal)
+{
+	DPRINTF("Calculating CRC for 0x%" PRIx32 " bytes, init CRC value is 0x%" PRIx64 "\n", length, initVal);
+
+	crc32_gentab();
+
+	return __atomic_load_n(&crc_func, __ATOMIC_ACQUIRE)(block, length, (uint32_t)initVal);
+}
+
+/*
+	Private function name:	gf2_matrix_times
+	Since version:		0.0.5
+	Description:		This function is used to multiply the 32x32 matrix over GF(2) by the vector
+	Arguments:		@mat [array]: matrix given by 32 columns
+				@vec [uint32_t]: vector
+	Returns:		product of the matrix and the vector
+*/
+static uint32_t gf2_matrix_times(uint32_t *mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+
+	while (vec) {
+		if (vec & 1)
+			sum ^= *mat;
+		vec >>= 1;
+		mat++;
+	}
+
+	return sum;
+}
+
+/*
+	Private function name:	gf2_matrix_square
+	Since version:		0.0.5
+	Description:		This function is used to square the 32x32 matrix over GF(2)
+	Arguments:		@square [array]: output matrix
+				@mat [array]: matrix to be squared
+	Returns:		None
+*/
+static void gf2_matrix_square(uint32_t *square, uint32_t *mat)
+{
+	int n;
+
+	for (n = 0; n < 32; n++)
+		square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+/*
+	Function name:		crc32_combine
+	Since version:		0.0.5
+	Description:		This function is used to get CRC-32 of two concatenated blocks from the CRC-32 values of the blocks. It applies the operator for len2 zero bytes to crc1, the operator is built by repeated squaring so it takes O(log(len2)) steps
+	Arguments:		@crc1 [uint32_t]: final CRC-32 value (as returned by crc32_file()) of the first block
+				@crc2 [uint32_t]: final CRC-32 value of the second block
+				@len2 [uint64_t]: size of the second block
+	Returns:		final CRC-32 value of the concatenation
+*/
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+	uint32_t even[32], odd[32], row;
+	int n;
+
+	if (len2 == 0)
+		return crc1;
+
+	/* Operator for one zero bit */
+	odd[0] = 0xEDB88320L;
+	row = 1;
+	for (n = 1; n < 32; n++) {
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	/* Operators for two and four zero bits, first square gives one zero byte */
+	gf2_matrix_square(even, odd);
+	gf2_matrix_square(odd, even);
+
+	do {
+		gf2_matrix_square(even, odd);
+		if (len2 & 1)
+			crc1 = gf2_matrix_times(even, crc1);
+		len2 >>= 1;
+
+		if (len2 == 0)
+			break;
+
+		gf2_matrix_square(odd, even);
+		if (len2 & 1)
+			crc1 = gf2_matrix_times(odd, crc1);
+		len2 >>= 1;
+	} while (len2 != 0);
+
+	return crc1 ^ crc2;
+}
+
+/*
+	Private function name:	crc32_range
+	Since version:		0.0.5
+	Description:		This function is used to calculate CRC-32 of the part of the file reading it by CRC_FILE_CHUNK_SIZE bytes
+	Arguments:		@fd [int]: file descriptor
+				@offset [uint64_t]: offset of the first byte
+				@size [uint64_t]: size of the part, UINT64_MAX to read up to the end of file
+				@crc [uint32_t]: output final CRC-32 value
+	Returns:		0 on success, -errno otherwise
+*/
+static int crc32_range(int fd, uint64_t offset, uint64_t size, uint32_t *crc)
+{
+	unsigned char *data;
+	uint32_t ret = 0xFFFFFFFF;
+	ssize_t rc = 0;
+	size_t len;
+
+	data = malloc( CRC_FILE_CHUNK_SIZE * sizeof(unsigned char) );
+	if (data == NULL)
+		return -ENOMEM;
+
+	while (size > 0) {
+		len = (size < CRC_FILE_CHUNK_SIZE) ? (size_t)size : CRC_FILE_CHUNK_SIZE;
+		rc = pread(fd, data, len, offset);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = -errno;
+			break;
+		}
+		if (rc == 0)
+			break;
+
+		ret = crc32_block(data, rc, ret);
+		offset += rc;
+		size -= rc;
+	}
+
+	free(data);
+
+	if (rc < 0)
+		return rc;
+
+	*crc = ret ^ 0xFFFFFFFF;
+	return 0;
 }
 
 uint32_t crc32_file(char *filename, int chunkSize)
@@ -76,19 +594,22 @@ uint32_t crc32_file(char *filename, int chunkSize)
 	int rc;
 
 	fd = open(filename, O_RDONLY);
-        if (chunkSize < 0) {
-		size = lseek(fd, 0, SEEK_END);
-		lseek(fd, 0, SEEK_SET);
-		DPRINTF("Got %s size: 0x%lx bytes\n", filename, size);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Cannot open file %s\n", filename);
+		return 0;
 	}
-	else {
+
+	/* Whole file is never read at once to keep the memory usage bounded */
+	if ((chunkSize <= 0) || (chunkSize > CRC_FILE_CHUNK_SIZE))
+		size = CRC_FILE_CHUNK_SIZE;
+	else
 		size = chunkSize;
-		DPRINTF("Getting %s CRC by 0x%lx bytes\n", filename, size);
-	}
+	DPRINTF("Getting %s CRC by 0x%lx bytes\n", filename, size);
 
-	data = malloc( (size + 1) * sizeof(unsigned char) );
+	data = malloc( size * sizeof(unsigned char) );
 	if (!data) {
 		fprintf(stderr, "Error: Cannot allocate memory for data\n");
+		close(fd);
 		return 0;
 	}
 
@@ -97,14 +618,132 @@ uint32_t crc32_file(char *filename, int chunkSize)
 	while ((rc = read(fd, data, size)) > 0) {
                 ret = crc32_block(data, rc, ret);
 		DPRINTF("Block size %d bytes: %" PRIx32 "\n", rc, ret);
-		memset(data, 0, size);
 	}
 
 	free(data);
+	close(fd);
 
 	return ret ^ 0xFFFFFFFF;
 }
 
+#ifndef WINDOWS
+typedef struct tCrcRange {
+	int fd;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t crc;
+	int ret;
+} tCrcRange;
+
+static void *crc32_range_thread(void *opaque)
+{
+	tCrcRange *range = (tCrcRange *)opaque;
+
+	range->ret = crc32_range(range->fd, range->offset, range->size, &range->crc);
+	return NULL;
+}
+#endif
+
+/*
+	Function name:		crc32_file_parallel
+	Since version:		0.0.5
+	Description:		This function is used to calculate CRC-32 of the file using several threads. The file is split into contiguous ranges, each of them is checksummed by a separate thread reading CRC_FILE_CHUNK_SIZE bytes at once and the results are merged by crc32_combine()
+	Arguments:		@filename [string]: name of the file
+				@threads [int]: number of threads, 0 to use the number of online CPUs
+				@crc [uint32_t]: output final CRC-32 value of the file
+	Returns:		0 on success, -errno otherwise
+*/
+int crc32_file_parallel(char *filename, int threads, uint32_t *crc)
+{
+	struct stat st;
+	int fd, i, ret = 0;
+#ifndef WINDOWS
+	tCrcRange *ranges = NULL;
+	pthread_t *tids = NULL;
+	uint64_t part;
+	int started;
+#endif
+
+	fd = open(filename, O_RDONLY
+		#ifdef USE_LARGE_FILE
+		 | O_LARGEFILE
+		#endif
+		);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) != 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+#ifndef WINDOWS
+	if (threads == 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* It's not worth to split small files */
+	if ((uint64_t)st.st_size < (uint64_t)threads * CRC_FILE_CHUNK_SIZE)
+		threads = st.st_size / CRC_FILE_CHUNK_SIZE;
+#else
+	threads = 1;
+#endif
+
+	if (threads <= 1) {
+		ret = crc32_range(fd, 0, UINT64_MAX, crc);
+		close(fd);
+		return ret;
+	}
+
+#ifndef WINDOWS
+	ranges = (tCrcRange *)malloc( threads * sizeof(tCrcRange) );
+	tids = (pthread_t *)malloc( threads * sizeof(pthread_t) );
+	if ((ranges == NULL) || (tids == NULL)) {
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+
+	/* Make sure the tables are ready before threads use them */
+	crc32_gentab();
+
+	part = st.st_size / threads;
+	for (started = 0; started < threads; started++) {
+		ranges[started].fd = fd;
+		ranges[started].offset = started * part;
+		/* Last range reads up to the end of file */
+		ranges[started].size = (started == threads - 1) ? UINT64_MAX : part;
+		ranges[started].crc = 0;
+		ranges[started].ret = 0;
+
+		if (pthread_create(&tids[started], NULL, crc32_range_thread, &ranges[started]) != 0) {
+			ret = -EAGAIN;
+			break;
+		}
+	}
+
+	DPRINTF("Getting %s CRC using %d threads\n", filename, started);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(tids[i], NULL);
+		if ((ret == 0) && (ranges[i].ret != 0))
+			ret = ranges[i].ret;
+	}
+
+	if (ret == 0) {
+		*crc = ranges[0].crc;
+		for (i = 1; i < threads; i++)
+			*crc = crc32_combine(*crc, ranges[i].crc, (i == threads - 1) ?
+						st.st_size - ranges[i].offset : part);
+	}
+
+cleanup:
+	free(ranges);
+	free(tids);
+#endif
+	close(fd);
+	return ret;
+}
+
 #ifdef TEST_CRC
 int getCRCOutput(char *command, uint32_t *crc)
 {
@@ -0,0 +1,572 @@
+/*
+ *  index.c: Chunk index footer for random-access decryption
+ *
+ *  Copyright (c) 2010-2011, Michal Novotny <mignov@gmail.com>
+ *  All rights reserved.
+ *
+ *  See COPYING for the license of this software
+ *
+ */
+
+#include "mincrypt.h"
+
+#ifndef DISABLE_DEBUG
+#define DEBUG_INDEX
+#endif
+
+#ifdef WINDOWS
+	#ifdef BUILDING_DLL
+		#define DLLEXPORT __declspec(dllexport)
+	#else
+		#define DLLEXPORT __declspec(dllimport)
+	#endif
+#else
+	#define DLLEXPORT
+#endif
+
+#ifdef DEBUG_INDEX
+#define DPRINTF(fmt, ...) \
+do { fprintf(stderr, "[mincrypt/index       ] " fmt , ## __VA_ARGS__); } while (0)
+#else
+#define DPRINTF(fmt, ...) \
+do {} while(0)
+#endif
+
+/*
+ * The index is appended after the last chunk of the encrypted file, all the values are big-endian:
+ *
+ *   header:  INDEX_SIGNATURE, INDEX_VERSION (1 byte), number of entries (4 bytes)
+ *   entries: chunk offset (8 bytes), offset of chunk data in the plain file (8 bytes), original size (4 bytes), chunk id (4 bytes)
+ *   trailer: offset of the index header (8 bytes), INDEX_SIGNATURE, INDEX_VERSION (1 byte)
+ *
+ * Sequential readers stop at the index header as it doesn't start with the chunk signature.
+ */
+
+/*
+	Function name:		chunk_parse_header
+	Since version:		0.0.5
+	Description:		This function is used to get the size of the encrypted chunk from its header
+	Arguments:		@hdr [buffer]: chunk header of strlen(SIGNATURE) + 17 bytes
+				@orig_size [uint32_t]: output value for the size of the plain data of the chunk
+	Returns:		size of the chunk including its header, 0 if the chunk index starts at hdr, -EINVAL for invalid header or the size over CHUNK_SIZE_MAX
+*/
+ssize_t chunk_parse_header(const unsigned char *hdr, uint32_t *orig_size)
+{
+	int siglen = strlen(SIGNATURE);
+	uint32_t enc_size;
+
+	if (memcmp(hdr, INDEX_SIGNATURE, strlen(INDEX_SIGNATURE)) == 0)
+		return 0;
+
+	if (memcmp(hdr, SIGNATURE, siglen) != 0)
+		return -EINVAL;
+
+	*orig_size = GETUINT32((hdr + siglen + 1));
+	enc_size = GETUINT32((hdr + siglen + 5));
+
+	/* No writer produces larger chunks, so don't let the header size the buffers of the reader */
+	if (*orig_size > CHUNK_SIZE_MAX)
+		return -EINVAL;
+
+	if (hdr[siglen] == ENCODING_TYPE_BINARY)
+		enc_size = *orig_size;
+	else
+	if ((hdr[siglen] != ENCODING_TYPE_BASE64) || (enc_size != base64_encoded_size(*orig_size)))
+		return -EINVAL;
+
+	return siglen + 17 + (ssize_t)enc_size;
+}
+
+/*
+	Private function name:	chunk_span_max
+	Since version:		0.0.5
+	Description:		This function is used to get the size of the largest valid chunk including its header, i.e. of the base64-encoded chunk of CHUNK_SIZE_MAX bytes
+	Arguments:		None
+	Returns:		maximum size of the chunk
+*/
+static uint64_t chunk_span_max(void)
+{
+	return strlen(SIGNATURE) + 17 + base64_encoded_size(CHUNK_SIZE_MAX);
+}
+
+/*
+	Function name:		chunk_check_span
+	Since version:		0.0.5
+	Description:		This function is used to check the chunk read using the span taken from the chunk index against its header so the index not matching the chunks cannot make the decryption read past the chunk
+	Arguments:		@chunk [buffer]: encrypted chunk
+				@chunk_size [uint64_t]: size of the chunk according to the index
+				@size [uint64_t]: size of the plain data of the chunk according to the index
+	Returns:		0 if the header matches the index entry, -EINVAL otherwise
+*/
+int chunk_check_span(const unsigned char *chunk, uint64_t chunk_size, uint64_t size)
+{
+	uint32_t orig_size;
+	ssize_t csize;
+
+	if (chunk_size < strlen(SIGNATURE) + 17)
+		return -EINVAL;
+
+	if (((csize = chunk_parse_header(chunk, &orig_size)) <= 0)
+		|| ((uint64_t)csize != chunk_size) || (orig_size != size)) {
+		DPRINTF("%s: Chunk header doesn't match the index entry\n", __FUNCTION__);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+	Function name:		chunk_index_add
+	Since version:		0.0.5
+	Description:		This function is used to append the entry for the next chunk written to the encrypted file
+	Arguments:		@idx [index]: index to add the entry to
+				@chunk_size [size_t]: size of the encrypted chunk including its header
+				@plain_size [size_t]: size of the plain data of the chunk
+				@id [int]: identifier of the chunk
+	Returns:		0 on success, -ENOMEM if cannot allocate memory
+*/
+int chunk_index_add(tChunkIndex *idx, size_t chunk_size, size_t plain_size, int id)
+{
+	tChunkIndexEntry *tmp;
+
+	if (idx->num == idx->allocated) {
+		tmp = (tChunkIndexEntry *)realloc(idx->entries, (idx->allocated + 64) * 2 * sizeof(tChunkIndexEntry));
+		if (tmp == NULL)
+			return -ENOMEM;
+
+		idx->entries = tmp;
+		idx->allocated = (idx->allocated + 64) * 2;
+	}
+
+	idx->entries[idx->num].offset = idx->offset;
+	idx->entries[idx->num].plain_offset = idx->plain_offset;
+	idx->entries[idx->num].size = (uint32_t)plain_size;
+	idx->entries[idx->num].id = (uint32_t)id;
+	idx->num++;
+
+	idx->offset += chunk_size;
+	idx->plain_offset += plain_size;
+	return 0;
+}
+
+/*
+	Function name:		chunk_index_plan
+	Since version:		0.0.5
+	Description:		This function is used to get the layout of the chunks of the file the plain data of given size will be encrypted to using the context
+	Arguments:		@ctx [context]: context to be used for the encryption
+				@idx [index]: output value for the chunk layout
+				@size [uint64_t]: size of the plain data
+	Returns:		0 on success, -ENOMEM if cannot allocate memory
+*/
+int chunk_index_plan(mincrypt_ctx_t *ctx, tChunkIndex *idx, uint64_t size)
+{
+	uint64_t off;
+	size_t len;
+	int ret = 0;
+
+	memset(idx, 0, sizeof(tChunkIndex));
+	for (off = 0; (ret == 0) && (off < size); off += len) {
+		len = (size - off < ctx->chunk_size) ? size - off : ctx->chunk_size;
+		ret = chunk_index_add(idx, mincrypt_ctx_get_encrypted_size(ctx, len), len, idx->num + 1);
+	}
+
+	if (ret != 0)
+		chunk_index_free(idx);
+
+	return ret;
+}
+
+/*
+	Function name:		chunk_index_serialize
+	Since version:		0.0.5
+	Description:		This function is used to get the index in the format to be appended right after the last chunk
+	Arguments:		@idx [index]: index to serialize
+				@size [size_t]: output value for the size of the serialized index
+	Returns:		newly allocated buffer with the index or NULL if cannot allocate memory
+*/
+unsigned char *chunk_index_serialize(tChunkIndex *idx, size_t *size)
+{
+	int siglen = strlen(INDEX_SIGNATURE);
+	unsigned char *out, *p;
+	int i;
+
+	*size = INDEX_HEADER_SIZE + idx->num * INDEX_ENTRY_SIZE + INDEX_TRAILER_SIZE;
+	if ((out = (unsigned char *)malloc( *size * sizeof(unsigned char) )) == NULL)
+		return NULL;
+
+	memcpy(out, INDEX_SIGNATURE, siglen);
+	out[siglen] = INDEX_VERSION;
+	UINT32STR((out + siglen + 1), (uint32_t)idx->num);
+
+	p = out + INDEX_HEADER_SIZE;
+	for (i = 0; i < idx->num; i++, p += INDEX_ENTRY_SIZE) {
+		UINT64STR(p, idx->entries[i].offset);
+		UINT64STR((p + 8), idx->entries[i].plain_offset);
+		UINT32STR((p + 16), idx->entries[i].size);
+		UINT32STR((p + 20), idx->entries[i].id);
+	}
+
+	UINT64STR(p, idx->offset);
+	memcpy(p + 8, INDEX_SIGNATURE, siglen);
+	p[8 + siglen] = INDEX_VERSION;
+
+	DPRINTF("%s: Index of %d entries takes %ld bytes\n", __FUNCTION__, idx->num, (unsigned long)*size);
+	return out;
+}
+
+/*
+	Function name:		chunk_index_write
+	Since version:		0.0.5
+	Description:		This function is used to append the index to the encrypted file right after its last chunk
+	Arguments:		@idx [index]: index to write
+				@fd [int]: file descriptor of the encrypted file
+	Returns:		0 on success, -errno on error
+*/
+int chunk_index_write(tChunkIndex *idx, int fd)
+{
+	unsigned char *data, *p;
+	size_t size;
+	ssize_t rc;
+	int ret = 0;
+
+	if ((data = chunk_index_serialize(idx, &size)) == NULL)
+		return -ENOMEM;
+
+	for (p = data; size > 0; p += rc, size -= rc) {
+		if ((rc = write(fd, p, size)) < 0) {
+			if (errno == EINTR) {
+				rc = 0;
+				continue;
+			}
+			ret = -errno;
+			break;
+		}
+	}
+
+	free(data);
+	return ret;
+}
+
+/*
+	Function name:		chunk_index_free
+	Since version:		0.0.5
+	Description:		This function is used to free the entries of the index
+	Arguments:		@idx [index]: index to be freed
+	Returns:		None
+*/
+void chunk_index_free(tChunkIndex *idx)
+{
+	free(idx->entries);
+	memset(idx, 0, sizeof(tChunkIndex));
+}
+
+/*
+	Function name:		pread_full
+	Since version:		0.0.5
+	Description:		This function is used to read exactly size bytes from the offset of the file
+	Arguments:		@fd [int]: file descriptor to read from
+				@buf [buffer]: buffer to read data to
+				@size [size_t]: number of bytes to read
+				@offset [uint64_t]: offset in the file
+	Returns:		0 on success, -EINVAL if the end of file is reached, -errno on error
+*/
+int pread_full(int fd, unsigned char *buf, size_t size, uint64_t offset)
+{
+	ssize_t rc;
+
+	while (size > 0) {
+		rc = pread(fd, buf, size, offset);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (rc == 0)
+			return -EINVAL;
+
+		buf += rc;
+		size -= rc;
+		offset += rc;
+	}
+
+	return 0;
+}
+
+/*
+	Private function name:	chunk_index_read_entry
+	Since version:		0.0.5
+	Description:		This function is used to read a single entry of the index stored in the file
+	Arguments:		@fd [int]: file descriptor of the encrypted file
+				@entries [uint64_t]: offset of the first entry in the file
+				@i [uint32_t]: number of the entry to read
+				@e [entry]: output value for the entry
+	Returns:		0 on success, -EINVAL for the size over CHUNK_SIZE_MAX, -errno on error
+*/
+static int chunk_index_read_entry(int fd, uint64_t entries, uint32_t i, tChunkIndexEntry *e)
+{
+	unsigned char buf[INDEX_ENTRY_SIZE];
+	int ret;
+
+	if ((ret = pread_full(fd, buf, INDEX_ENTRY_SIZE, entries + (uint64_t)i * INDEX_ENTRY_SIZE)) != 0)
+		return ret;
+
+	e->offset = GETUINT64(buf);
+	e->plain_offset = GETUINT64((buf + 8));
+	e->size = GETUINT32((buf + 16));
+	e->id = GETUINT32((buf + 20));
+
+	if (e->size > CHUNK_SIZE_MAX)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+	Private function name:	chunk_index_locate
+	Since version:		0.0.5
+	Description:		This function is used to find the chunk index in the encrypted file and to validate its header and trailer
+	Arguments:		@fd [int]: file descriptor of the encrypted file
+				@index_offset [uint64_t]: output value for the offset of the index, i.e. the end of the last chunk
+				@num [uint32_t]: output value for the number of entries
+	Returns:		0 on success, -ENOENT if the file has no index, -EINVAL for invalid index, -errno otherwise
+*/
+static int chunk_index_locate(int fd, uint64_t *index_offset, uint32_t *num)
+{
+	int siglen = strlen(INDEX_SIGNATURE);
+	unsigned char hdr[32];
+	struct stat st;
+	int ret;
+
+	if (fstat(fd, &st) != 0)
+		return -errno;
+
+	if (!S_ISREG(st.st_mode) || (st.st_size < INDEX_HEADER_SIZE + INDEX_TRAILER_SIZE))
+		return -ENOENT;
+
+	if ((ret = pread_full(fd, hdr, INDEX_TRAILER_SIZE, st.st_size - INDEX_TRAILER_SIZE)) != 0)
+		return ret;
+
+	if ((memcmp(hdr + 8, INDEX_SIGNATURE, siglen) != 0) || (hdr[8 + siglen] != INDEX_VERSION)) {
+		DPRINTF("%s: No chunk index found\n", __FUNCTION__);
+		return -ENOENT;
+	}
+
+	*index_offset = GETUINT64(hdr);
+	if ((*index_offset > st.st_size - INDEX_HEADER_SIZE - INDEX_TRAILER_SIZE)
+		|| ((ret = pread_full(fd, hdr, INDEX_HEADER_SIZE, *index_offset)) != 0)
+		|| (memcmp(hdr, INDEX_SIGNATURE, siglen) != 0) || (hdr[siglen] != INDEX_VERSION))
+		return -EINVAL;
+
+	*num = GETUINT32((hdr + siglen + 1));
+	if (*index_offset + INDEX_HEADER_SIZE + (uint64_t)*num * INDEX_ENTRY_SIZE + INDEX_TRAILER_SIZE != st.st_size) {
+		DPRINTF("%s: Index of %"PRIu32" entries doesn't match file size\n", __FUNCTION__, *num);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+	Function name:		chunk_index_scan
+	Since version:		0.0.5
+	Description:		This function is used to get the layout of all the chunks of the encrypted file. The chunk index is used if present, otherwise the chunk headers are walked from the beginning of the file reading only the headers
+	Arguments:		@fd [int]: file descriptor of the encrypted file, file position is not changed
+				@idx [index]: output value for the chunk layout, idx->offset is set to the end of the last chunk
+	Returns:		0 on success, -EINVAL for invalid file, -errno otherwise (-ESPIPE if the file is not seekable)
+*/
+int chunk_index_scan(int fd, tChunkIndex *idx)
+{
+	int siglen = strlen(SIGNATURE);
+	unsigned char hdr[32], *data, *p;
+	uint64_t index_offset, end;
+	uint32_t num, i, orig_size;
+	ssize_t csize;
+	int ret;
+
+	memset(idx, 0, sizeof(tChunkIndex));
+
+	if ((ret = chunk_index_locate(fd, &index_offset, &num)) == 0) {
+		if ((data = (unsigned char *)malloc( ((size_t)num + 1) * INDEX_ENTRY_SIZE )) == NULL)
+			return -ENOMEM;
+
+		if ((ret = pread_full(fd, data, (size_t)num * INDEX_ENTRY_SIZE, index_offset + INDEX_HEADER_SIZE)) != 0) {
+			free(data);
+			return ret;
+		}
+
+		/* Entries must describe adjacent chunks ending right before the index */
+		for (i = 0, p = data; (ret == 0) && (i < num); i++, p += INDEX_ENTRY_SIZE) {
+			end = (i + 1 < num) ? GETUINT64((p + INDEX_ENTRY_SIZE)) : index_offset;
+
+			if ((GETUINT64(p) != idx->offset) || (GETUINT64((p + 8)) != idx->plain_offset)
+				|| (end < idx->offset + siglen + 17) || (end - idx->offset > chunk_span_max())
+				|| (GETUINT32((p + 16)) > CHUNK_SIZE_MAX))
+				ret = -EINVAL;
+			else
+				ret = chunk_index_add(idx, end - idx->offset, GETUINT32((p + 16)), GETUINT32((p + 20)));
+		}
+		free(data);
+
+		if (ret != 0)
+			chunk_index_free(idx);
+
+		DPRINTF("%s: Got %"PRIu32" chunks from the index with code %d\n", __FUNCTION__, num, ret);
+		return ret;
+	}
+	if (ret != -ENOENT)
+		return ret;
+
+	/* No index, walk the chunk headers */
+	for (i = 1; ; i++) {
+		if ((ret = pread(fd, hdr, siglen + 17, idx->offset)) == 0)
+			break;
+		if (ret < 0) {
+			ret = -errno;
+			break;
+		}
+
+		/* Chunk index ends the chunks even if its trailer is not valid */
+		if ((ret >= strlen(INDEX_SIGNATURE)) && (memcmp(hdr, INDEX_SIGNATURE, strlen(INDEX_SIGNATURE)) == 0)) {
+			ret = 0;
+			break;
+		}
+		if ((ret != siglen + 17) || ((csize = chunk_parse_header(hdr, &orig_size)) <= 0)) {
+			ret = -EINVAL;
+			break;
+		}
+
+		if ((ret = chunk_index_add(idx, csize, orig_size, i)) != 0)
+			break;
+	}
+
+	if (ret != 0)
+		chunk_index_free(idx);
+
+	DPRINTF("%s: Walked %d chunk headers with code %d\n", __FUNCTION__, idx->num, ret);
+	return ret;
+}
+
+/*
+	Function name:		mincrypt_ctx_pread
+	Since version:		0.0.5
+	Description:		This function is used to decrypt the part of the encrypted file without processing the whole file. The chunk index of the file is used to locate and decrypt only the chunks overlapping the requested range of the plain data
+	Arguments:		@ctx [context]: context to be used for the decryption
+				@fd [int]: file descriptor of the encrypted file with the chunk index, file position is not changed
+				@buf [buffer]: buffer for the plain data
+				@len [size_t]: number of bytes to read
+				@offset [uint64_t]: offset in the plain data
+	Returns:		number of bytes read (less than len only at the end of the plain data), -ENOENT if the file has no index, -EINVAL for invalid file or CRC mismatch, -errno otherwise
+*/
+DLLEXPORT ssize_t mincrypt_ctx_pread(mincrypt_ctx_t *ctx, int fd, unsigned char *buf, size_t len, uint64_t offset)
+{
+	unsigned char *chunk = NULL, *plain = NULL;
+	size_t chunk_alloc = 0, plain_alloc = 0, done = 0, skip, n, new_size;
+	uint64_t index_offset, entries, chunk_size;
+	uint32_t num, lo, hi, mid;
+	tChunkIndexEntry e, next;
+	int ret = 0;
+
+	if ((ret = chunk_index_locate(fd, &index_offset, &num)) != 0)
+		return ret;
+
+	entries = index_offset + INDEX_HEADER_SIZE;
+	if ((num == 0) || (len == 0))
+		return 0;
+
+	/* Find the last chunk starting at or before the offset */
+	lo = 0;
+	hi = num - 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if ((ret = chunk_index_read_entry(fd, entries, mid, &e)) != 0)
+			return ret;
+
+		if (e.plain_offset <= offset)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	DPRINTF("%s: Reading %ld bytes at 0x%"PRIx64" starting with chunk #%"PRIu32"\n", __FUNCTION__,
+			(unsigned long)len, offset, lo);
+
+	if ((ret = chunk_index_read_entry(fd, entries, lo, &e)) != 0)
+		return ret;
+
+	while ((done < len) && (offset + done < e.plain_offset + e.size)) {
+		if (lo + 1 < num) {
+			if ((ret = chunk_index_read_entry(fd, entries, lo + 1, &next)) != 0)
+				break;
+
+			/* Entries must describe adjacent chunks as checked by chunk_index_scan() */
+			if ((next.offset <= e.offset) || (next.plain_offset != e.plain_offset + e.size)) {
+				ret = -EINVAL;
+				break;
+			}
+			chunk_size = next.offset - e.offset;
+		}
+		else
+			chunk_size = index_offset - e.offset;
+
+		if ((chunk_size > index_offset) || (chunk_size > chunk_span_max()) || (offset + done < e.plain_offset)) {
+			ret = -EINVAL;
+			break;
+		}
+
+		if (chunk_alloc < chunk_size) {
+			free(chunk);
+			chunk_alloc = chunk_size;
+			if ((chunk = (unsigned char *)malloc( chunk_alloc * sizeof(unsigned char) )) == NULL) {
+				ret = -ENOMEM;
+				break;
+			}
+		}
+
+		if (((ret = pread_full(fd, chunk, chunk_size, e.offset)) != 0)
+			|| ((ret = chunk_check_span(chunk, chunk_size, e.size)) != 0))
+			break;
+
+		skip = offset + done - e.plain_offset;
+		n = e.size - skip;
+		if (n > len - done)
+			n = len - done;
+
+		/* Decrypt chunks covered completely right into the caller's buffer */
+		if (n == e.size)
+			ret = mincrypt_ctx_decrypt_into(ctx, chunk, chunk_size, e.id, buf + done, n, &new_size, NULL);
+		else {
+			if (plain_alloc < e.size) {
+				free(plain);
+				plain_alloc = e.size;
+				if ((plain = (unsigned char *)malloc( plain_alloc * sizeof(unsigned char) )) == NULL) {
+					ret = -ENOMEM;
+					break;
+				}
+			}
+
+			ret = mincrypt_ctx_decrypt_into(ctx, chunk, chunk_size, e.id, plain, e.size, &new_size, NULL);
+			if (ret == 0)
+				memcpy(buf + done, plain + skip, n);
+		}
+
+		if ((ret == 0) && (new_size != e.size))
+			ret = -EINVAL;
+		if (ret != 0)
+			break;
+
+		done += n;
+		if (++lo == num)
+			break;
+		e = next;
+	}
+
+	free(chunk);
+	free(plain);
+
+	if (ret != 0) {
+		DPRINTF("%s: Reading failed with code %d\n", __FUNCTION__, ret);
+		return ret;
+	}
+
+	return done;
+}
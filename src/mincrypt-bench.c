@@ -0,0 +1,591 @@
+/*
+ *  mincrypt-bench.c: Throughput benchmark of the minCrypt building blocks
+ *
+ *  Copyright (c) 2010-2011, Michal Novotny <mignov@gmail.com>
+ *  All rights reserved.
+ *
+ *  See COPYING for the license of this software
+ *
+ */
+
+#include "mincrypt.h"
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#define BENCH_SALT			"bench"
+#define BENCH_PASSWORD			"benchmark"
+#define BENCH_MIN_TIME			0.1				/* minimal duration of a single sample in seconds */
+
+/* Function to be benchmarked, processes bench->size bytes of the plain data per call */
+typedef int (*tBenchFunc)(void *opaque);
+
+typedef struct tBenchResult {
+	uint64_t bytes;
+	double seconds;
+	uint64_t cycles;
+} tBenchResult;
+
+/* Data shared by the benchmarked functions */
+typedef struct tBench {
+	unsigned char *data;
+	size_t size;
+	size_t chunk_size;
+	unsigned char *encoded;		/* base64 encoded data */
+	size_t encoded_size;
+	unsigned char **chunks;		/* encrypted chunks of the data */
+	size_t *chunk_sizes;
+	int num_chunks;
+	mincrypt_ctx_t *ctx;
+	cipher_key_t key;
+	char file[1024];
+	char file_enc[1024];
+	char file_dec[1024];
+} tBench;
+
+size_t size		= 1 << 24;
+uint64_t file_size	= 1 << 26;
+int iterations		= 3;
+char *outfile		= NULL;
+char *tmpdir		= NULL;
+char *only		= NULL;
+
+FILE *out		= NULL;
+int num_results		= 0;
+
+int parseArgs(int argc, char * const argv[]) {
+	int option_index = 0, c;
+	struct option long_options[] = {
+		{"size", 1, 0, 's'},
+		{"file-size", 1, 0, 'f'},
+		{"iterations", 1, 0, 'n'},
+		{"output", 1, 0, 'o'},
+		{"tmpdir", 1, 0, 't'},
+		{"only", 1, 0, 'O'},
+		{0, 0, 0, 0}
+	};
+
+	char *optstring = "s:f:n:o:t:";
+
+	while (1) {
+		c = getopt_long(argc, argv, optstring,
+			long_options, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+			case 's':
+				if (atoll(optarg) < CHUNK_SIZE_MIN)
+					return 1;
+				size = (size_t)atoll(optarg);
+				break;
+			case 'f':
+				if (atoll(optarg) < 0)
+					return 1;
+				file_size = (uint64_t)atoll(optarg);
+				break;
+			case 'n':
+				iterations = atoi(optarg);
+				if (iterations < 1)
+					return 1;
+				break;
+			case 'o':
+				outfile = optarg;
+				break;
+			case 't':
+				tmpdir = optarg;
+				break;
+			case 'O':
+				only = optarg;
+				break;
+			default:
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+	Function name:		bench_time
+	Since version:		0.0.5
+	Description:		This function is used to get the monotonic time with the nanosecond resolution
+	Arguments:		None
+	Returns:		time in seconds
+*/
+double bench_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+	Function name:		bench_cycles
+	Since version:		0.0.5
+	Description:		This function is used to read the time stamp counter of the CPU
+	Arguments:		None
+	Returns:		number of cycles, 0 if the counter is not available
+*/
+uint64_t bench_cycles(void)
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*
+	Function name:		bench_fill
+	Since version:		0.0.5
+	Description:		This function is used to fill the buffer with the pseudo-random data so the data cannot be compressed by the storage
+	Arguments:		@buf [buffer]: buffer to fill
+				@len [size_t]: size of the buffer
+	Returns:		None
+*/
+void bench_fill(unsigned char *buf, size_t len)
+{
+	uint64_t x = 0x9E3779B97F4A7C15ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		buf[i] = (unsigned char)x;
+	}
+}
+
+/*
+	Function name:		bench_enabled
+	Since version:		0.0.5
+	Description:		This function is used to check whether the benchmark of the function has been selected by the --only option
+	Arguments:		@name [string]: name of the measured function
+	Returns:		1 if the benchmark should be run, 0 otherwise
+*/
+int bench_enabled(char *name)
+{
+	return (only == NULL) || (strstr(name, only) != NULL);
+}
+
+/*
+	Function name:		bench_run
+	Since version:		0.0.5
+	Description:		This function is used to measure the throughput of the function. Each sample calls the function repeatedly for at least BENCH_MIN_TIME seconds and the fastest of the samples is used
+	Arguments:		@func [function]: function to measure
+				@opaque [pointer]: argument passed to the function
+				@bytes [uint64_t]: number of bytes processed by a single call
+				@res [result]: output variable for the result
+	Returns:		0 for no error, error code of the function otherwise
+*/
+int bench_run(tBenchFunc func, void *opaque, uint64_t bytes, tBenchResult *res)
+{
+	double t, elapsed;
+	uint64_t c, calls;
+	int i, ret;
+
+	memset(res, 0, sizeof(tBenchResult));
+
+	/* Warm up the caches and allocator */
+	if ((ret = func(opaque)) != 0)
+		return ret;
+
+	for (i = 0; i < iterations; i++) {
+		calls = 0;
+		t = bench_time();
+		c = bench_cycles();
+		do {
+			if ((ret = func(opaque)) != 0)
+				return ret;
+			calls++;
+		} while ((elapsed = bench_time() - t) < BENCH_MIN_TIME);
+		c = bench_cycles() - c;
+
+		if ((res->bytes == 0) || (elapsed / calls < res->seconds / (res->bytes / bytes))) {
+			res->bytes = bytes * calls;
+			res->seconds = elapsed;
+			res->cycles = c;
+		}
+	}
+
+	return 0;
+}
+
+/*
+	Function name:		bench_report
+	Since version:		0.0.5
+	Description:		This function is used to measure the function and write the result as the JSON object of the results array
+	Arguments:		@name [string]: name of the measured function
+				@params [string]: JSON members describing the parameters, may be NULL
+				@func [function]: function to measure
+				@opaque [pointer]: argument passed to the function
+				@bytes [uint64_t]: number of bytes processed by a single call
+	Returns:		0 for no error, otherwise error code
+*/
+int bench_report(char *name, char *params, tBenchFunc func, void *opaque, uint64_t bytes)
+{
+	tBenchResult res;
+	int ret;
+
+	if (!bench_enabled(name))
+		return 0;
+
+	if ((ret = bench_run(func, opaque, bytes, &res)) != 0) {
+		fprintf(stderr, "Benchmark of %s { %s } failed with error code %d\n", name, params ? params : "", ret);
+		return ret;
+	}
+
+	fprintf(out, "%s\n\t\t{ \"name\": \"%s\", ", num_results++ ? "," : "", name);
+	if (params != NULL)
+		fprintf(out, "%s, ", params);
+	fprintf(out, "\"bytes\": %"PRIu64", \"seconds\": %.6f, \"mb_per_s\": %.2f, ",
+		res.bytes, res.seconds, res.bytes / res.seconds / (1 << 20));
+	if (res.cycles > 0)
+		fprintf(out, "\"cycles_per_byte\": %.3f }", (double)res.cycles / res.bytes);
+	else
+		fprintf(out, "\"cycles_per_byte\": null }");
+	fflush(out);
+
+	fprintf(stderr, "%-20s %-60s %10.2f MB/s\n", name, params ? params : "", res.bytes / res.seconds / (1 << 20));
+	return 0;
+}
+
+int bench_crc32(void *opaque)
+{
+	tBench *bench = (tBench *)opaque;
+
+	crc32_block(bench->data, bench->size, 0xFFFFFFFF);
+	return 0;
+}
+
+int bench_base64_encode(void *opaque)
+{
+	tBench *bench = (tBench *)opaque;
+	size_t len = bench->size;
+
+	free(base64_encode((const char *)bench->data, &len));
+	return 0;
+}
+
+int bench_base64_decode(void *opaque)
+{
+	tBench *bench = (tBench *)opaque;
+	unsigned char *buf;
+	size_t len = bench->encoded_size;
+
+	if ((buf = base64_decode((const char *)bench->encoded, &len)) == NULL)
+		return -EINVAL;
+
+	free(buf);
+	return 0;
+}
+
+int bench_cipher(void *opaque)
+{
+	tBench *bench = (tBench *)opaque;
+	size_t off, len;
+	int id = 1;
+
+	/* Key stream is initialized per chunk as done by mincrypt_encrypt() */
+	for (off = 0; off < bench->size; off += len) {
+		len = (bench->size - off < bench->chunk_size) ? bench->size - off : bench->chunk_size;
+		cipher_key_init(&bench->key, bench->ctx, len, 0, id++, CIPHER_MODE_SYMMETRIC_ENCRYPT, 0);
+		cipher_key_apply(&bench->key, bench->data + off, bench->data + off, 0, len);
+	}
+
+	return 0;
+}
+
+int bench_encrypt(void *opaque)
+{
+	tBench *bench = (tBench *)opaque;
+	unsigned char *buf;
+	size_t off, len, new_size;
+	int id = 1;
+
+	for (off = 0; off < bench->size; off += len) {
+		len = (bench->size - off < bench->chunk_size) ? bench->size - off : bench->chunk_size;
+		if ((buf = mincrypt_encrypt(bench->data + off, len, id++, &new_size)) == NULL)
+			return -ENOMEM;
+		free(buf);
+	}
+
+	return 0;
+}
+
+int bench_decrypt(void *opaque)
+{
+	tBench *bench = (tBench *)opaque;
+	unsigned char *buf;
+	size_t new_size;
+	int i, read_size;
+
+	for (i = 0; i < bench->num_chunks; i++) {
+		if ((buf = mincrypt_decrypt(bench->chunks[i], bench->chunk_sizes[i], i + 1, &new_size, &read_size)) == NULL)
+			return -EINVAL;
+		free(buf);
+	}
+
+	return 0;
+}
+
+int bench_encrypt_file(void *opaque)
+{
+	tBench *bench = (tBench *)opaque;
+
+	return mincrypt_encrypt_file(bench->file, bench->file_enc, NULL, NULL, 0);
+}
+
+int bench_decrypt_file(void *opaque)
+{
+	tBench *bench = (tBench *)opaque;
+
+	return mincrypt_decrypt_file(bench->file_enc, bench->file_dec, NULL, NULL, 0);
+}
+
+/*
+	Function name:		bench_chunks_free
+	Since version:		0.0.5
+	Description:		This function is used to free the encrypted chunks used by the decryption benchmark
+	Arguments:		@bench [bench]: benchmark data
+	Returns:		None
+*/
+void bench_chunks_free(tBench *bench)
+{
+	int i;
+
+	for (i = 0; i < bench->num_chunks; i++)
+		free(bench->chunks[i]);
+	free(bench->chunks);
+	free(bench->chunk_sizes);
+
+	bench->chunks = NULL;
+	bench->chunk_sizes = NULL;
+	bench->num_chunks = 0;
+}
+
+/*
+	Function name:		bench_chunks_alloc
+	Since version:		0.0.5
+	Description:		This function is used to encrypt the data into the chunks for the decryption benchmark using the current settings of the default context
+	Arguments:		@bench [bench]: benchmark data
+	Returns:		0 for no error, -ENOMEM if cannot allocate memory
+*/
+int bench_chunks_alloc(tBench *bench)
+{
+	size_t off, len;
+	int num;
+
+	num = (bench->size + bench->chunk_size - 1) / bench->chunk_size;
+	bench->chunks = (unsigned char **)calloc( num, sizeof(unsigned char *) );
+	bench->chunk_sizes = (size_t *)calloc( num, sizeof(size_t) );
+	if ((bench->chunks == NULL) || (bench->chunk_sizes == NULL))
+		return -ENOMEM;
+
+	for (off = 0; off < bench->size; off += len) {
+		len = (bench->size - off < bench->chunk_size) ? bench->size - off : bench->chunk_size;
+		bench->chunks[bench->num_chunks] = mincrypt_encrypt(bench->data + off, len, bench->num_chunks + 1,
+							&bench->chunk_sizes[bench->num_chunks]);
+		if (bench->chunks[bench->num_chunks++] == NULL)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+	Function name:		bench_write_file
+	Since version:		0.0.5
+	Description:		This function is used to create the input file for the file benchmarks
+	Arguments:		@bench [bench]: benchmark data
+				@len [uint64_t]: size of the file
+	Returns:		0 for no error, otherwise error code
+*/
+int bench_write_file(tBench *bench, uint64_t len)
+{
+	size_t n;
+	int fd, ret = 0;
+
+	if ((fd = open(bench->file, O_WRONLY | O_TRUNC | O_CREAT, 0600)) < 0)
+		return -errno;
+
+	while ((ret == 0) && (len > 0)) {
+		n = (len < bench->size) ? len : bench->size;
+		if (write(fd, bench->data, n) != n)
+			ret = -EIO;
+		len -= n;
+	}
+
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t chunk_sizes[] = { 1 << 12, 1 << 16, BUFFER_SIZE, 1 << 20 };
+	size_t file_chunk_sizes[] = { BUFFER_SIZE, 1 << 20 };
+	int vector_mults[] = { 32, 128 };
+	int encodings[] = { ENCODING_TYPE_BINARY, ENCODING_TYPE_BASE64 };
+	int threads[] = { 1, 2, 4, 0 };
+	char *crc32_impls[] = { NULL, "bytewise", "slice8", "slice16", "pclmul" };
+	char *cipher_kernels[] = { NULL, "scalar", "sse2", "avx2" };
+	char *base64_kernels[] = { NULL, "scalar", "avx2" };
+	char params[256];
+	tBench bench;
+	size_t len;
+	int i, j, k, ret = 0;
+
+	if (parseArgs(argc, argv)) {
+		printf("Syntax: %s [--size=bytes] [--file-size=bytes] [--iterations=number] [--output=file] [--tmpdir=dir] "
+			"[--only=name]\n", argv[0]);
+		return 1;
+	}
+
+	out = stdout;
+	if ((outfile != NULL) && ((out = fopen(outfile, "w")) == NULL)) {
+		fprintf(stderr, "Cannot open file '%s' for writing (%s)\n", outfile, strerror(errno));
+		return 2;
+	}
+
+	memset(&bench, 0, sizeof(bench));
+	bench.size = size;
+	if ((bench.data = (unsigned char *)malloc( size * sizeof(unsigned char) )) == NULL) {
+		fprintf(stderr, "Cannot allocate %lu bytes of memory\n", (unsigned long)size);
+		return 2;
+	}
+	bench_fill(bench.data, size);
+
+	fprintf(out, "{\n\t\"version\": \"%s\",\n\t\"size\": %lu,\n\t\"file_size\": %"PRIu64",\n\t\"iterations\": %d,\n"
+		"\t\"cycles\": \"%s\",\n\t\"results\": [", PACKAGE_VERSION, (unsigned long)size, file_size, iterations,
+	#ifdef HAVE_TSC
+		"tsc"
+	#else
+		"none"
+	#endif
+		);
+
+	/* CRC-32 of the plain data */
+	for (i = CRC32_IMPL_BYTEWISE; (ret == 0) && (i <= CRC32_IMPL_PCLMUL); i++) {
+		if (crc32_set_impl(i) != 0)
+			continue;
+
+		snprintf(params, sizeof(params), "\"impl\": \"%s\"", crc32_impls[i]);
+		ret = bench_report("crc32_block", params, bench_crc32, &bench, size);
+	}
+	crc32_set_impl(CRC32_IMPL_AUTO);
+
+	/* Base64 encoding and decoding */
+	len = size;
+	bench.encoded = base64_encode((const char *)bench.data, &len);
+	bench.encoded_size = len;
+	for (i = BASE64_KERNEL_SCALAR; (ret == 0) && (i <= BASE64_KERNEL_AVX2); i++) {
+		if (base64_set_kernel(i) != 0)
+			continue;
+
+		snprintf(params, sizeof(params), "\"kernel\": \"%s\"", base64_kernels[i]);
+		if ((ret = bench_report("base64_encode", params, bench_base64_encode, &bench, size)) == 0)
+			ret = bench_report("base64_decode", params, bench_base64_decode, &bench, size);
+	}
+	base64_set_kernel(BASE64_KERNEL_AUTO);
+	free(bench.encoded);
+
+	/* Transformation of the data using the key stream */
+	bench.ctx = mincrypt_ctx_create();
+	bench.chunk_size = BUFFER_SIZE;
+	for (i = CIPHER_KERNEL_SCALAR; (ret == 0) && (bench.ctx != NULL) && (i <= CIPHER_KERNEL_AVX2); i++) {
+		if (cipher_set_kernel(i) != 0)
+			continue;
+
+		for (j = 0; (ret == 0) && (j < sizeof(vector_mults) / sizeof(vector_mults[0])); j++) {
+			mincrypt_ctx_set_password(bench.ctx, BENCH_SALT, BENCH_PASSWORD, vector_mults[j]);
+
+			snprintf(params, sizeof(params), "\"kernel\": \"%s\", \"vector_multiplier\": %d, \"chunk_size\": %lu",
+				cipher_kernels[i], vector_mults[j], (unsigned long)bench.chunk_size);
+			ret = bench_report("cipher", params, bench_cipher, &bench, size);
+		}
+	}
+	cipher_set_kernel(CIPHER_KERNEL_AUTO);
+	mincrypt_ctx_free(bench.ctx);
+
+	/* Encryption and decryption of the chunks in memory */
+	for (i = 0; (ret == 0) && (i < sizeof(encodings) / sizeof(encodings[0])); i++) {
+		mincrypt_set_encoding_type(encodings[i]);
+
+		for (j = 0; (ret == 0) && (j < sizeof(vector_mults) / sizeof(vector_mults[0])); j++) {
+			mincrypt_set_password(BENCH_SALT, BENCH_PASSWORD, vector_mults[j]);
+
+			for (k = 0; (ret == 0) && (k < sizeof(chunk_sizes) / sizeof(chunk_sizes[0])); k++) {
+				bench.chunk_size = chunk_sizes[k];
+
+				snprintf(params, sizeof(params), "\"encoding\": \"%s\", \"vector_multiplier\": %d, \"chunk_size\": %lu",
+					(encodings[i] == ENCODING_TYPE_BASE64) ? "base64" : "binary", vector_mults[j],
+					(unsigned long)bench.chunk_size);
+
+				if ((ret = bench_report("mincrypt_encrypt", params, bench_encrypt, &bench, size)) != 0)
+					break;
+
+				if (bench_enabled("mincrypt_decrypt") && ((ret = bench_chunks_alloc(&bench)) == 0))
+					ret = bench_report("mincrypt_decrypt", params, bench_decrypt, &bench, size);
+				bench_chunks_free(&bench);
+			}
+		}
+	}
+	mincrypt_set_encoding_type(ENCODING_TYPE_BINARY);
+
+	/* Encryption and decryption of the files, the page cache is not dropped so mostly CPU bound */
+	if ((ret == 0) && (file_size > 0) && (bench_enabled("mincrypt_encrypt_file") || bench_enabled("mincrypt_decrypt_file"))) {
+		if (tmpdir == NULL)
+			tmpdir = (getenv("TMPDIR") != NULL) ? getenv("TMPDIR") : "/tmp";
+
+		snprintf(bench.file, sizeof(bench.file), "%s/mincrypt-bench.%d", tmpdir, (int)getpid());
+		snprintf(bench.file_enc, sizeof(bench.file_enc), "%s/mincrypt-bench.%d.enc", tmpdir, (int)getpid());
+		snprintf(bench.file_dec, sizeof(bench.file_dec), "%s/mincrypt-bench.%d.dec", tmpdir, (int)getpid());
+
+		if ((ret = bench_write_file(&bench, file_size)) != 0)
+			fprintf(stderr, "Cannot create file '%s' (%s)\n", bench.file, strerror(-ret));
+
+		mincrypt_set_password(BENCH_SALT, BENCH_PASSWORD, DEFAULT_VECTOR_MULT);
+		for (i = 0; (ret == 0) && (i < sizeof(threads) / sizeof(threads[0])); i++) {
+			if (mincrypt_set_threads(threads[i]) != 0)
+				continue;
+
+			for (j = 0; (ret == 0) && (j < sizeof(file_chunk_sizes) / sizeof(file_chunk_sizes[0])); j++) {
+				mincrypt_set_chunk_size(file_chunk_sizes[j]);
+
+				snprintf(params, sizeof(params), "\"threads\": %d, \"chunk_size\": %lu", threads[i],
+					(unsigned long)file_chunk_sizes[j]);
+
+				/* Encrypted file is created by the encryption benchmark or has to be created here */
+				if (bench_enabled("mincrypt_encrypt_file"))
+					ret = bench_report("mincrypt_encrypt_file", params, bench_encrypt_file, &bench, file_size);
+				else
+					ret = bench_encrypt_file(&bench);
+
+				if (ret == 0)
+					ret = bench_report("mincrypt_decrypt_file", params, bench_decrypt_file, &bench, file_size);
+			}
+		}
+
+		unlink(bench.file);
+		unlink(bench.file_enc);
+		unlink(bench.file_dec);
+	}
+
+	fprintf(out, "\n\t]\n}\n");
+	if (out != stdout)
+		fclose(out);
+
+	free(bench.data);
+	mincrypt_cleanup();
+
+	if (ret != 0)
+		fprintf(stderr, "Benchmark failed with error code: %d\n", ret);
+
+	return (ret != 0) ? 2 : 0;
+}
@@ -33,6 +33,16 @@ int vector_mult	= -1;
 int keysize	= 0;
 int decrypt	= 0;
 int simple_mode	= 0;
+int threads	= 1;
+int checksum	= 0;
+int use_index	= 0;
+int io_mode	= IO_MODE_READ;
+int direct	= 0;
+int stats	= 0;
+int64_t chunk_size = -1;
+int64_t offset	= -1;
+int64_t length	= -1;
+int std_out	= -1;
 
 int parseArgs(int argc, char * const argv[]) {
 	int option_index = 0, c;
@@ -48,10 +58,19 @@ int parseArgs(int argc, char * const argv[]) {
 		{"key-size", 1, 0, 'k'},
 		{"key-file", 1, 0, 'f'},
 		{"dump-vectors", 1, 0, 'u'},
+		{"threads", 1, 0, 'n'},
+		{"checksum", 0, 0, 'c'},
+		{"index", 0, 0, 'x'},
+		{"offset", 1, 0, 'O'},
+		{"length", 1, 0, 'L'},
+		{"io", 1, 0, 'I'},
+		{"direct", 0, 0, 'D'},
+		{"chunk-size", 1, 0, 'C'},
+		{"stats", 0, 0, 'S'},
 		{0, 0, 0, 0}
 	};
 
-	char *optstring = "i:o:p:s:v:k:u:d";
+	char *optstring = "i:o:p:s:v:k:u:n:dc";
 
 	while (1) {
 		c = getopt_long(argc, argv, optstring,
@@ -82,6 +101,48 @@ int parseArgs(int argc, char * const argv[]) {
 			case 'd':
 				decrypt = 1;
 				break;
+			case 'c':
+				checksum = 1;
+				break;
+			case 'x':
+				use_index = 1;
+				break;
+			case 'D':
+				direct = 1;
+				break;
+			case 'S':
+				stats = 1;
+				break;
+			case 'C':
+				chunk_size = (strcmp(optarg, "auto") == 0) ? CHUNK_SIZE_AUTO : atoll(optarg);
+				if ((chunk_size != CHUNK_SIZE_AUTO) && ((chunk_size < CHUNK_SIZE_MIN) || (chunk_size > CHUNK_SIZE_MAX)))
+					return 1;
+				break;
+			case 'O':
+				offset = atoll(optarg);
+				if (offset < 0)
+					return 1;
+				break;
+			case 'L':
+				length = atoll(optarg);
+				if (length < 0)
+					return 1;
+				break;
+			case 'I':
+				if (strcmp(optarg, "read") == 0)
+					io_mode = IO_MODE_READ;
+				else
+				if (strcmp(optarg, "mmap") == 0)
+					io_mode = IO_MODE_MMAP;
+				else
+				if (strcmp(optarg, "mmap-rw") == 0)
+					io_mode = IO_MODE_MMAP_RW;
+				else
+				if (strcmp(optarg, "uring") == 0)
+					io_mode = IO_MODE_URING;
+				else
+					return 1;
+				break;
 			case 'k':
 				keysize = atoi(optarg);
 				if (keysize < 128)
@@ -93,6 +154,11 @@ int parseArgs(int argc, char * const argv[]) {
 			case 'u':
 				dump_file = optarg;
 				break;
+			case 'n':
+				threads = atoi(optarg);
+				if (threads < 0)
+					return 1;
+				break;
 			case 'v':
 				vector_mult = atoi(optarg);
 				if (vector_mult < 32)
@@ -100,7 +166,137 @@ int parseArgs(int argc, char * const argv[]) {
 		}
 	}
 
-	return ((((infile != NULL) && (outfile != NULL)) || ((keyfile != NULL) && (keysize > 0))) ? 0 : 1);
+	/* Range can be read from the encrypted file only */
+	if (((offset >= 0) || (length >= 0)) && !decrypt)
+		return 1;
+
+	/* Standard input cannot be read at the offset or by multiple threads for checksum only */
+	if ((infile != NULL) && (strcmp(infile, "-") == 0) && ((offset >= 0) || (length >= 0) || (outfile == NULL)))
+		return 1;
+
+	return ((((infile != NULL) && ((outfile != NULL) || checksum)) || ((keyfile != NULL) && (keysize > 0))) ? 0 : 1);
+}
+
+/*
+	Function name:		open_output
+	Since version:		0.0.5
+	Description:		This function is used to open the output file, "-" stands for the standard output
+	Arguments:		@filename [string]: output file name
+	Returns:		file descriptor, -1 on error with errno set
+*/
+int open_output(char *filename)
+{
+	if (strcmp(filename, "-") == 0)
+		return std_out;
+
+	return open(filename, ((io_mode == IO_MODE_MMAP_RW) ? O_RDWR : O_WRONLY) | O_TRUNC | O_CREAT, 0644);
+}
+
+/*
+	Function name:		process_fd
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the file using the descriptors so "-" can be used for the standard input and output
+	Arguments:		@filename1 [string]: input file, "-" for the standard input
+				@filename2 [string]: output file, "-" for the standard output
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+	Returns:		0 for no error, otherwise error code
+*/
+int process_fd(char *filename1, char *filename2, int decrypt)
+{
+	int fd, fdOut, ret;
+
+	fd = (strcmp(filename1, "-") == 0) ? STDIN_FILENO : open(filename1, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	if ((fdOut = open_output(filename2)) < 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	ret = decrypt ? mincrypt_decrypt_fd(fd, fdOut) : mincrypt_encrypt_fd(fd, fdOut);
+
+	close(fd);
+	close(fdOut);
+
+	if ((ret != 0) && (strcmp(filename2, "-") != 0))
+		unlink(filename2);
+
+	return ret;
+}
+
+/*
+	Function name:		decrypt_range
+	Since version:		0.0.5
+	Description:		This function is used to decrypt the range of the plain data from the encrypted file with the chunk index
+	Arguments:		@filename1 [string]: input (encrypted) file
+				@filename2 [string]: output (decrypted) file
+				@offset [int64_t]: offset in the plain data
+				@length [int64_t]: number of bytes to decrypt, negative to decrypt up to the end
+	Returns:		0 for no error, otherwise error code
+*/
+int decrypt_range(char *filename1, char *filename2, int64_t offset, int64_t length)
+{
+	unsigned char buf[BUFFER_SIZE];
+	int fd, fdOut, ret = 0;
+	ssize_t rc = 0;
+	size_t len;
+
+	if ((fd = open(filename1, O_RDONLY)) < 0)
+		return -errno;
+
+	if ((fdOut = open_output(filename2)) < 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	while (length != 0) {
+		len = ((length < 0) || (length > sizeof(buf))) ? sizeof(buf) : length;
+		if ((rc = mincrypt_pread(fd, buf, len, offset)) <= 0)
+			break;
+
+		if (write(fdOut, buf, rc) != rc) {
+			rc = -EIO;
+			break;
+		}
+
+		offset += rc;
+		if (length > 0)
+			length -= rc;
+	}
+
+	if (rc < 0) {
+		ret = (int)rc;
+		if (strcmp(filename2, "-") != 0)
+			unlink(filename2);
+	}
+
+	close(fd);
+	close(fdOut);
+	return ret;
+}
+
+/*
+	Function name:		print_stats
+	Since version:		0.0.5
+	Description:		This function is used to print the runtime statistics of the processing. Time is summed up over all the threads so it may exceed the real time
+	Arguments:		None
+	Returns:		None
+*/
+void print_stats(void)
+{
+	mincrypt_stats_t st;
+
+	if (mincrypt_get_stats(&st) != 0)
+		return;
+
+	printf("Statistics:\n");
+	printf("  Bytes in: %"PRIu64", bytes out: %"PRIu64", chunks: %"PRIu64"\n", st.bytes_in, st.bytes_out, st.chunks);
+	printf("  CRC failures: %"PRIu64", allocations: %"PRIu64"\n", st.crc_failures, st.allocations);
+	printf("  Time spent: CRC-32 %.3f ms, cipher %.3f ms, base64 %.3f ms, I/O %.3f ms\n",
+		st.ns_crc / 1e6, st.ns_cipher / 1e6, st.ns_base64 / 1e6, st.ns_io / 1e6);
 }
 
 int main(int argc, char *argv[])
@@ -111,11 +307,34 @@ int main(int argc, char *argv[])
 	if (parseArgs(argc, argv)) {
 		printf("Syntax: %s --input-file=infile --output-file=outfile [--decrypt] [--password=pwd] [--salt=salt] "
 			"[--vector-multiplier=number] [--type=base64|binary] [--simple-mode] [--key-size <keysize> "
-			"--key-file <keyfile-prefix>] [--dump-vectors <dump-file>]\n",
+			"--key-file <keyfile-prefix>] [--dump-vectors <dump-file>] [--threads=number] [--checksum] [--index] "
+			"[--offset=number] [--length=number] [--io=read|mmap|mmap-rw|uring] [--direct] [--chunk-size=bytes|auto] [--stats]\n"
+			"Use '-' as infile or outfile for the standard input or output\n",
 				argv[0]);
 		return 1;
 	}
 
+	/* Data are written to the standard output so all the messages have to go to the standard error output */
+	if ((outfile != NULL) && (strcmp(outfile, "-") == 0)) {
+		if (((std_out = dup(STDOUT_FILENO)) < 0) || (dup2(STDERR_FILENO, STDOUT_FILENO) < 0)) {
+			fprintf(stderr, "Cannot redirect standard output (%s)\n", strerror(errno));
+			return 2;
+		}
+	}
+
+	/* Only checksum the input file if no output file is given */
+	if ((outfile == NULL) && checksum) {
+		uint32_t crc = 0;
+
+		if ((ret = crc32_file_parallel(infile, threads, &crc)) != 0) {
+			fprintf(stderr, "Cannot get checksum of '%s' (error code %d, %s)\n", infile, ret, strerror(-ret));
+			return 2;
+		}
+
+		printf("CRC-32 checksum of %s: %08"PRIx32"\n", infile, crc);
+		return 0;
+	}
+
 	if (salt == NULL)
 		salt = DEFAULT_SALT_VAL;
 
@@ -175,10 +394,44 @@ int main(int argc, char *argv[])
 		if (mincrypt_set_simple_mode(1) != 0)
 			printf("Warning: Cannot set simple mode for non-binary encoding\n");
 
+	if (mincrypt_set_threads(threads) != 0)
+		printf("Warning: Cannot set number of threads, using single thread instead\n");
+
+	if (use_index)
+		mincrypt_set_index(1);
+
+	if ((io_mode != IO_MODE_READ) && (mincrypt_set_io_mode(io_mode) != 0))
+		printf("Warning: Cannot set I/O mode, using read and write instead\n");
+
+	if (direct && (mincrypt_set_direct(1) != 0))
+		printf("Warning: Direct I/O is not supported, using page cache instead\n");
+
+	/* Chunk size is given by the chunk headers for decryption */
+	if ((chunk_size >= 0) && !decrypt)
+		mincrypt_set_chunk_size((size_t)chunk_size);
+
+	if (stats)
+		mincrypt_set_stats(1);
+
+	/* Same order of the arguments as always passed to mincrypt_encrypt_file() and mincrypt_decrypt_file() */
+	mincrypt_set_password(password, salt, vector_mult);
+
+	if ((offset >= 0) || (length >= 0))
+		ret = decrypt_range(infile, outfile, (offset > 0) ? offset : 0, length);
+	else
+	if ((strcmp(infile, "-") == 0) || (strcmp(outfile, "-") == 0))
+		ret = process_fd(infile, outfile, decrypt);
+	else
 	if (!decrypt)
-		ret = mincrypt_encrypt_file(infile, outfile, password, salt, vector_mult);
+		ret = mincrypt_encrypt_file(infile, outfile, NULL, NULL, vector_mult);
 	else
-		ret = mincrypt_decrypt_file(infile, outfile, password, salt, vector_mult);
+		ret = mincrypt_decrypt_file(infile, outfile, NULL, NULL, vector_mult);
+
+	if ((ret == 0) && checksum && (offset < 0) && (length < 0))
+		printf("CRC-32 checksum of the plain data: %08"PRIx32"\n", mincrypt_get_checksum());
+
+	if (stats)
+		print_stats();
 
 	if (dump_file != NULL)
 		mincrypt_dump_vectors(dump_file);
@@ -8,8 +8,16 @@
  *
  */
 
+#ifndef WINDOWS
+#define _GNU_SOURCE			/* O_DIRECT */
+#endif
+
 #include "mincrypt.h"
 
+#ifndef WINDOWS
+#include <pthread.h>
+#endif
+
 #ifndef DISABLE_DEBUG
 #define DEBUG_MINCRYPT
 #endif
@@ -32,15 +40,32 @@ do { fprintf(stderr, "[mincrypt/corelib     ] " fmt , ## __VA_ARGS__); } while (
 do {} while(0)
 #endif
 
-uint32_t *_iv = NULL;
-uint32_t *_ivn = NULL; // used for asymmetric approach
-uint32_t *_iva = NULL; // used for asymmetric approach
-uint64_t _ival = 0;
-int _vector_size = 0;
-int _avector_size = -1;// used for asymmetric approach
-int type_approach = APPROACH_SYMMETRIC;
-int out_type = ENCODING_TYPE_BINARY;
-int simple_mode = 0;
+/* Size of the part of a chunk processed at once, multiple of 3 for base64 encoding */
+#define PROCESS_TILE_SIZE		(3 << 11)
+
+#define MINCRYPT_CTX_INITIALIZER	{ NULL, NULL, NULL, 0, 0, -1, APPROACH_SYMMETRIC, ENCODING_TYPE_BINARY, 0, 0, 0, 0, IO_MODE_READ, 0, BUFFER_SIZE, 0, { 0 } }
+
+/* Size of the blocks read by the file decryption */
+#define DECRYPT_READ_SIZE		(1 << 20)
+
+/* Range of the chunk sizes benchmarked by autotune_chunk_size(), also the amount of data encrypted per pass */
+#define AUTOTUNE_MIN_SIZE		(1 << 15)
+#define AUTOTUNE_DATA_SIZE		(1 << 22)
+
+/* Alignment of the buffers, file offsets and transfer sizes for O_DIRECT */
+#define DIRECT_IO_ALIGN			4096
+
+/* Output file of the stream */
+typedef struct tFileSink {
+	mincrypt_ctx_t *ctx;
+	int fd;
+	uint64_t total;
+	unsigned char *buf;		/* aligned buffer collecting whole blocks for direct I/O, NULL to write right away */
+	size_t len;
+} tFileSink;
+
+/* Context used by the functions not taking the context argument */
+static mincrypt_ctx_t default_ctx = MINCRYPT_CTX_INITIALIZER;
 
 /*
 	Private function name:	get_nearest_power_of_two
@@ -145,7 +170,7 @@ void write_data(int fd, unsigned char *data, int num)
 	}
 }
 
-int read_key_data(int fd, int bits, int isPrivate)
+int read_key_data(mincrypt_ctx_t *ctx, int fd, int bits, int isPrivate)
 {
 	int i, in, c, num;
 	char buf[10] = { 0 };
@@ -157,7 +182,7 @@ int read_key_data(int fd, int bits, int isPrivate)
 	if (bits != 32)
 		return -EINVAL;
 
-	if ((_iva == NULL) || (_ivn == NULL))
+	if ((ctx->iva == NULL) || (ctx->ivn == NULL))
 		return -EIO;
 
 	i = in = num = 0;
@@ -170,12 +195,12 @@ int read_key_data(int fd, int bits, int isPrivate)
 			val = (uint32_t) strtol(tmp, &endptr, 16);
 
 			if (num % 2 == 1) {
-				_iva[i++] = val;
-				_ival += val;
+				ctx->iva[i++] = val;
+				ctx->ival += val;
 			}
 			else {
 				if (!isPrivate)
-					_ivn[in++] = val;
+					ctx->ivn[in++] = val;
 				else {
 					uint16_t p, q;
 
@@ -184,7 +209,7 @@ int read_key_data(int fd, int bits, int isPrivate)
 
 					get_decryption_value(p, q, 0, &val64);
 
-					_ivn[in++] = (uint32_t)val64;
+					ctx->ivn[in++] = (uint32_t)val64;
 				}
 			}
 
@@ -271,14 +296,76 @@ DLLEXPORT long mincrypt_get_version(void)
 }
 
 /*
-	Function name:		mincrypt_read_key_file
-	Since version:		0.0.3
-	Description:		This function is used to read the keyfile identified by keyfile string.
-	Arguments:		@keyfile [string]: file with private or public key
+	Function name:		mincrypt_ctx_create
+	Since version:		0.0.5
+	Description:		This function is used to allocate a new encryption context. Each context holds its own initialization vectors and settings so multiple contexts can be used at once
+	Arguments:		None
+	Returns:		new context or NULL on error, to be freed by mincrypt_ctx_free()
+*/
+DLLEXPORT mincrypt_ctx_t *mincrypt_ctx_create(void)
+{
+	mincrypt_ctx_t init = MINCRYPT_CTX_INITIALIZER;
+	mincrypt_ctx_t *ctx = NULL;
+
+	ctx = (mincrypt_ctx_t *)malloc( sizeof(mincrypt_ctx_t) );
+	if (ctx == NULL) {
+		DPRINTF("%s: Cannot allocate memory for context\n", __FUNCTION__);
+		return NULL;
+	}
+
+	memcpy(ctx, &init, sizeof(mincrypt_ctx_t));
+	return ctx;
+}
+
+/*
+	Function name:		mincrypt_ctx_cleanup
+	Since version:		0.0.5
+	Description:		This function is used to cleanup all the memory allocated for the context by mincrypt_ctx_set_password() and mincrypt_ctx_read_key_file() functions. The context itself can be used again
+	Arguments:		@ctx [context]: context to be cleaned up
+	Returns:		None
+*/
+DLLEXPORT void mincrypt_ctx_cleanup(mincrypt_ctx_t *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	free(ctx->iv);
+	free(ctx->iva);
+	free(ctx->ivn);
+
+	ctx->iv = ctx->iva = ctx->ivn = NULL;
+	ctx->ival = 0;
+	ctx->vector_size = 0;
+	ctx->avector_size = -1;
+	ctx->type_approach = APPROACH_SYMMETRIC;
+}
+
+/*
+	Function name:		mincrypt_ctx_free
+	Since version:		0.0.5
+	Description:		This function is used to cleanup and free the context allocated by mincrypt_ctx_create() function
+	Arguments:		@ctx [context]: context to be freed
+	Returns:		None
+*/
+DLLEXPORT void mincrypt_ctx_free(mincrypt_ctx_t *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	mincrypt_ctx_cleanup(ctx);
+	free(ctx);
+}
+
+/*
+	Function name:		mincrypt_ctx_read_key_file
+	Since version:		0.0.5
+	Description:		This function is used to read the keyfile identified by keyfile string into the context.
+	Arguments:		@ctx [context]: context to read the key into
+				@keyfile [string]: file with private or public key
 				@isPrivate [out int]: output variable set to 1 if key file contains private key or 0 if it contains public key
 	Returns:		0 for no error, -errno otherwise
 */
-DLLEXPORT int mincrypt_read_key_file(char *keyfile, int *oIsPrivate)
+DLLEXPORT int mincrypt_ctx_read_key_file(mincrypt_ctx_t *ctx, char *keyfile, int *oIsPrivate)
 {
 	int fd;
 	int isPrivate;
@@ -301,38 +388,49 @@ DLLEXPORT int mincrypt_read_key_file(char *keyfile, int *oIsPrivate)
 	if (oIsPrivate != NULL)
 		*oIsPrivate = isPrivate;
 
-        _avector_size = ((fileSize - (56 + 59)) / 9) / 2;
+        ctx->avector_size = ((fileSize - (56 + 59)) / 9) / 2;
 
-	if (_iva != NULL)
-		_iva = realloc( _iva, _avector_size * sizeof(uint32_t) );
+	if (ctx->iva != NULL)
+		ctx->iva = realloc( ctx->iva, ctx->avector_size * sizeof(uint32_t) );
 	else
-		_iva = malloc( _avector_size * sizeof(uint32_t) );
+		ctx->iva = malloc( ctx->avector_size * sizeof(uint32_t) );
 
-	if (_ivn != NULL)
-		_ivn = realloc( _ivn, _avector_size * sizeof(uint32_t) );
+	if (ctx->ivn != NULL)
+		ctx->ivn = realloc( ctx->ivn, ctx->avector_size * sizeof(uint32_t) );
 	else
-		_ivn = malloc( _avector_size * sizeof(uint32_t) );
+		ctx->ivn = malloc( ctx->avector_size * sizeof(uint32_t) );
 
-	if ((_iva == NULL) || (_ivn == NULL)) {
-		free(_iva);
-		free(_ivn);
+	if ((ctx->iva == NULL) || (ctx->ivn == NULL))
 		ret = -ENOMEM;
-	}
 	else
-	if (read_key_data(fd, bits, isPrivate) != 0)
+	if (read_key_data(ctx, fd, bits, isPrivate) != 0)
 		ret = -EINVAL;
 
 	close(fd);
 
 	if (ret != 0) {
-		free(_ivn);
-		free(_iva);
+		free(ctx->ivn);
+		free(ctx->iva);
+		ctx->ivn = ctx->iva = NULL;
 	}
 
-	type_approach = APPROACH_ASYMMETRIC;
+	ctx->type_approach = APPROACH_ASYMMETRIC;
 	return ret;
 }
 
+/*
+	Function name:		mincrypt_read_key_file
+	Since version:		0.0.3
+	Description:		This function is used to read the keyfile identified by keyfile string.
+	Arguments:		@keyfile [string]: file with private or public key
+				@isPrivate [out int]: output variable set to 1 if key file contains private key or 0 if it contains public key
+	Returns:		0 for no error, -errno otherwise
+*/
+DLLEXPORT int mincrypt_read_key_file(char *keyfile, int *oIsPrivate)
+{
+	return mincrypt_ctx_read_key_file(&default_ctx, keyfile, oIsPrivate);
+}
+
 /*
 	Function name:		mincrypt_generate_keys
 	Since version:		0.0.3
@@ -528,13 +626,14 @@ cleanup:
 }
 
 /*
-	Function name:		mincrypt_dump_vectors
-	Since version:		0.0.3
-	Description:		This function is used to dump the initialization vectors and save them into a file
-	Arguments:		@dump_file [string]: a file to store the dump to
-	Returns:		0 for no error, -errno otherwise
+	Function name:		mincrypt_ctx_dump_vectors
+	Since version:		0.0.5
+	Description:		This function is used to dump the initialization vectors of the context and save them into a file
+	Arguments:		@ctx [context]: context to dump the vectors of
+				@dump_file [string]: a file to store the dump to
+	Returns:		None
 */
-DLLEXPORT void mincrypt_dump_vectors(char *dump_file)
+DLLEXPORT void mincrypt_ctx_dump_vectors(mincrypt_ctx_t *ctx, char *dump_file)
 {
 	int fd, num = 0;
 	char data[1024] = { 0 };
@@ -546,22 +645,22 @@ DLLEXPORT void mincrypt_dump_vectors(char *dump_file)
 	snprintf(data, sizeof(data), "--- MINCRYPT %s DUMP DATA ---\n\n", PACKAGE_VERSION);
 	write(fd, data, strlen(data));
 
-	if (_iv != NULL) {
+	if (ctx->iv != NULL) {
 		snprintf(data, sizeof(data), "--- INITIALIZATION VECTORS _IV ---\n");
 		write(fd, data, strlen(data));
-		write_data(fd, (void *)_iv, _vector_size);
+		write_data(fd, (void *)ctx->iv, ctx->vector_size);
 		num++;
 	}
-	if (_ivn != NULL) {
+	if (ctx->ivn != NULL) {
 		snprintf(data, sizeof(data), "--- INITIALIZATION VECTORS _IVN ---\n");
 		write(fd, data, strlen(data));
-		write_data(fd, (void *)_ivn, _avector_size);
+		write_data(fd, (void *)ctx->ivn, ctx->avector_size);
 		num++;
 	}
-	if (_iva != NULL) {
+	if (ctx->iva != NULL) {
 		snprintf(data, sizeof(data), "--- INITIALIZATION VECTORS _IVA ---\n");
 		write(fd, data, strlen(data));
-		write_data(fd, (void *)_iva, _avector_size);
+		write_data(fd, (void *)ctx->iva, ctx->avector_size);
 		num++;
 	}
 
@@ -570,6 +669,38 @@ DLLEXPORT void mincrypt_dump_vectors(char *dump_file)
 	DPRINTF("%s: All (%d) initialization vectors saved to %s\n", __FUNCTION__, num, dump_file);
 }
 
+/*
+	Function name:		mincrypt_dump_vectors
+	Since version:		0.0.3
+	Description:		This function is used to dump the initialization vectors and save them into a file
+	Arguments:		@dump_file [string]: a file to store the dump to
+	Returns:		0 for no error, -errno otherwise
+*/
+DLLEXPORT void mincrypt_dump_vectors(char *dump_file)
+{
+	mincrypt_ctx_dump_vectors(&default_ctx, dump_file);
+}
+
+/*
+	Function name:		mincrypt_ctx_set_encoding_type
+	Since version:		0.0.5
+	Description:		This function is used to set type of output encoding for the context
+	Arguments:		@ctx [context]: context to set the encoding type for
+				@type [int]: type number, can be either ENCODING_TYPE_BINARY (i.e. no encoding) or ENCODING_TYPE_BASE64 to use base64 encoding
+	Returns:		0 for no error, otherwise error code (1 for unsupported encoding and 2 for enabling simple mode for non-binary encoding)
+*/
+DLLEXPORT int mincrypt_ctx_set_encoding_type(mincrypt_ctx_t *ctx, int type)
+{
+	if ((type < ENCODING_TYPE_BASE) || (type > ENCODING_TYPE_BASE64))
+		return 1;
+
+	if (ctx->simple_mode && (type != ENCODING_TYPE_BINARY))
+		return 2;
+
+	ctx->out_type = type;
+	return 0;
+}
+
 /*
 	Function name:		mincrypt_set_encoding_type
 	Since version:		0.0.1
@@ -579,13 +710,23 @@ DLLEXPORT void mincrypt_dump_vectors(char *dump_file)
 */
 DLLEXPORT int mincrypt_set_encoding_type(int type)
 {
-	if ((type < ENCODING_TYPE_BASE) || (type > ENCODING_TYPE_BASE64))
-		return 1;
+	return mincrypt_ctx_set_encoding_type(&default_ctx, type);
+}
 
-	if (simple_mode && (type != ENCODING_TYPE_BINARY))
-		return 2;
+/*
+	Function name:		mincrypt_ctx_set_simple_mode
+	Since version:		0.0.5
+	Description:		This function is used to enable or disable simple mode on the decryption phase for the context. Simple mode is the mode where CRC-32 checking and read size checking are disabled. Other encoding than binary encoding cannot work in this mode.
+	Arguments:		@ctx [context]: context to set the simple mode for
+				@enable [int]:	enable (1) or disable (0) simple mode checking code for decryption phase
+	Returns:		0 on success, 1 on error (trying to set simple mode on non-binary encoding)
+*/
+DLLEXPORT int mincrypt_ctx_set_simple_mode(mincrypt_ctx_t *ctx, int enable)
+{
+	if ((ctx->out_type != ENCODING_TYPE_BINARY) && (enable != 0))
+		return 1;
 
-	out_type = type;
+	ctx->simple_mode = enable;
 	return 0;
 }
 
@@ -598,23 +739,20 @@ DLLEXPORT int mincrypt_set_encoding_type(int type)
 */
 DLLEXPORT int mincrypt_set_simple_mode(int enable)
 {
-	if ((out_type != ENCODING_TYPE_BINARY) && (enable != 0))
-		return 1;
-
-	simple_mode = enable;
-	return 0;
+	return mincrypt_ctx_set_simple_mode(&default_ctx, enable);
 }
 
 /*
-	Function name:		mincrypt_set_password
-	Since version:		0.0.1
-	Description:		This function is used to calculate initialization vectors (IV) from the password and salt values
-	Arguments:		@salt [string]: salt value to be used for the IV generation
+	Function name:		mincrypt_ctx_set_password
+	Since version:		0.0.5
+	Description:		This function is used to calculate initialization vectors (IV) of the context from the password and salt values
+	Arguments:		@ctx [context]: context to calculate the IVs for
+				@salt [string]: salt value to be used for the IV generation
 				@password [string]: password to be used for IV generation
 				@vector_multiplier [int]: value to extend the vector by multiplicating it's size
 	Returns:		None
 */
-DLLEXPORT void mincrypt_set_password(char *salt, char *password, int vector_multiplier)
+DLLEXPORT void mincrypt_ctx_set_password(mincrypt_ctx_t *ctx, char *salt, char *password, int vector_multiplier)
 {
 	uint32_t val = 0, iSalt = 0, initial = 0;
 	uint64_t initialValue = 0;
@@ -625,8 +763,9 @@ DLLEXPORT void mincrypt_set_password(char *salt, char *password, int vector_mult
 
 	lenSalt = strlen(salt);
 	lenPass = strlen(password);
-	_vector_size = lenSalt * lenPass * vector_mult;
+	ctx->vector_size = lenSalt * lenPass * vector_mult;
 
+	/* IVs depend on the default chunk size, not the one set for the context, to keep the files compatible */
 	get_nearest_power_of_two(BUFFER_SIZE, &bits);
 	DPRINTF("Chunk is encoded on %d bits\n", bits);
 
@@ -645,285 +784,779 @@ DLLEXPORT void mincrypt_set_password(char *salt, char *password, int vector_mult
 
 	DPRINTF("%s: initial = 0x%"PRIx32"\n", __FUNCTION__, initial);
 
-	if (_iv != NULL)
-		_iv = realloc( _iv, _vector_size * sizeof(uint32_t) );
+	if (ctx->iv != NULL)
+		ctx->iv = realloc( ctx->iv, ctx->vector_size * sizeof(uint32_t) );
 	else
-		_iv = malloc( _vector_size * sizeof(uint32_t) );
+		ctx->iv = malloc( ctx->vector_size * sizeof(uint32_t) );
 
-	for (i = 0; i < _vector_size; i++) {
+	for (i = 0; i < ctx->vector_size; i++) {
 		val = savedpass[i % strlen(savedpass)];
-		_iv[i] = (initialValue % UINT32_MAX) + (initial
+		ctx->iv[i] = (initialValue % UINT32_MAX) + (initial
 					+ iSalt
 					+ (uint32_t)pow( savedpass[(passSum - val) % strlen(savedpass) ], (passSum + i) / val)
 				 );
 
-		//DPRINTF("Got initialization vector %d: %08" PRIx32"\n", i, _iv[i]);
-		initialValue += _iv[i];
+		//DPRINTF("Got initialization vector %d: %08" PRIx32"\n", i, ctx->iv[i]);
+		initialValue += ctx->iv[i];
 	}
 	free(savedpass);
 
-	DPRINTF("%s: Vector generated, elements: %d\n", __FUNCTION__, _vector_size);
+	DPRINTF("%s: Vector generated, elements: %d\n", __FUNCTION__, ctx->vector_size);
 
-	_ival = initial + initialValue;
-	DPRINTF("%s: initialValue = 0x%"PRIx64"\n", __FUNCTION__, _ival);
+	ctx->ival = initial + initialValue;
+	DPRINTF("%s: initialValue = 0x%"PRIx64"\n", __FUNCTION__, ctx->ival);
 
-	if (_avector_size == -1)
-		type_approach = APPROACH_SYMMETRIC;
+	if (ctx->avector_size == -1)
+		ctx->type_approach = APPROACH_SYMMETRIC;
 }
 
 /*
-	Function name:		mincrypt_cleanup
-	Since version:		0.0.1
-	Description:		This function is used to cleanup all the memory allocated by crypt_set_password() function
-	Arguments:		None
-	Returns:		None
+	Function name:		mincrypt_ctx_set_threads
+	Since version:		0.0.5
+	Description:		This function is used to set the number of worker threads used by the file encryption and decryption functions of the context
+	Arguments:		@ctx [context]: context to set the number of threads for
+				@threads [int]: number of threads, 1 to process the file in the calling thread only or 0 to use one thread per online CPU
+	Returns:		0 on success, -EINVAL for invalid number of threads
 */
-DLLEXPORT void mincrypt_cleanup(void)
+DLLEXPORT int mincrypt_ctx_set_threads(mincrypt_ctx_t *ctx, int threads)
 {
-	_ival = 0;
-	if (_iv != NULL)
-		free(_iv);
-	if (_iva != NULL)
-		free(_iva);
-	if (_ivn != NULL)
-		free(_ivn);
+	if (threads < 0)
+		return -EINVAL;
+
+#ifndef WINDOWS
+	if (threads == 0)
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	threads = 1;
+#endif
+
+	ctx->threads = (threads > 0) ? threads : 1;
+	return 0;
 }
 
 /*
-	Private function name:	mincrypt_process
-	Since version:		0.0.1
-	Description:		This function is used to process the encryption and decryption of the data block
-	Arguments:		@block [buffer]: buffer of data to be encrypted/decrypted
-				@size [int]: size of buffer
-				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
-				@crc [uint32_t]: CRC value for the data block (used as a part of algorithm)
-				@id [int]: identifier of the chunk to be encoded (used as a part of algorithm)
-				@abShift [uint64_t]: asymmetric block shift value (key type based on decrypt bit)
-	Returns:		output buffer of identical length as original
+	Function name:		mincrypt_set_threads
+	Since version:		0.0.5
+	Description:		This function is used to set the number of worker threads used by the file encryption and decryption functions
+	Arguments:		@threads [int]: number of threads, 1 to process the file in the calling thread only or 0 to use one thread per online CPU
+	Returns:		0 on success, -EINVAL for invalid number of threads
 */
-static unsigned char *mincrypt_process(unsigned char *block, int size, int decrypt, uint32_t crc, int id, uint64_t *abShift)
+DLLEXPORT int mincrypt_set_threads(int threads)
 {
-	int i, shiftByte = 0;
-	unsigned char *out = NULL;
+	return mincrypt_ctx_set_threads(&default_ctx, threads);
+}
 
-	if (_iv == NULL) {
-		fprintf(stderr, "Error: Initialization vectors are not initialized\n");
-		return NULL;
-	}
+/*
+	Function name:		mincrypt_ctx_get_checksum
+	Since version:		0.0.5
+	Description:		This function is used to get the CRC-32 checksum of the plain data of the last file encrypted or decrypted using the context. It's merged from CRC-32 values of the chunks by crc32_combine() so it costs no additional pass over the data
+	Arguments:		@ctx [context]: context used for the file encryption or decryption
+	Returns:		CRC-32 checksum of the plain data
+*/
+DLLEXPORT uint32_t mincrypt_ctx_get_checksum(mincrypt_ctx_t *ctx)
+{
+	return ctx->checksum;
+}
 
-	if ((type_approach == APPROACH_ASYMMETRIC) && (abShift == NULL)) {
-		DPRINTF("%s: Asymmetric approach requires abShift pointer to be non-null\n", __FUNCTION__);
-		return NULL;
-	}
+/*
+	Function name:		mincrypt_get_checksum
+	Since version:		0.0.5
+	Description:		This function is used to get the CRC-32 checksum of the plain data of the last file encrypted or decrypted
+	Arguments:		None
+	Returns:		CRC-32 checksum of the plain data
+*/
+DLLEXPORT uint32_t mincrypt_get_checksum(void)
+{
+	return mincrypt_ctx_get_checksum(&default_ctx);
+}
 
-	if (size <= 0) {
-		DPRINTF("%s: Invalid size of %d\n", __FUNCTION__, size);
-		return NULL;
-	}
+/*
+	Function name:		mincrypt_ctx_set_index
+	Since version:		0.0.5
+	Description:		This function is used to enable or disable the chunk index appended to the files encrypted using the context. The index allows random-access decryption using mincrypt_ctx_pread() but files with the index cannot be decrypted by versions older than 0.0.5
+	Arguments:		@ctx [context]: context to set the index for
+				@enable [int]: enable (1) or disable (0) the chunk index
+	Returns:		0 on success
+*/
+DLLEXPORT int mincrypt_ctx_set_index(mincrypt_ctx_t *ctx, int enable)
+{
+	ctx->index = enable;
+	return 0;
+}
 
-	out = (unsigned char *)malloc( (size + 1) * sizeof(unsigned char) );
-	if (out == NULL) {
-		DPRINTF("%s: Cannot allocate %d bytes of memory\n", __FUNCTION__, size + 1);
-		return NULL;
-	}
+/*
+	Function name:		mincrypt_set_index
+	Since version:		0.0.5
+	Description:		This function is used to enable or disable the chunk index appended to the encrypted files, see mincrypt_ctx_set_index()
+	Arguments:		@enable [int]: enable (1) or disable (0) the chunk index
+	Returns:		0 on success
+*/
+DLLEXPORT int mincrypt_set_index(int enable)
+{
+	return mincrypt_ctx_set_index(&default_ctx, enable);
+}
 
-	memset(out, 0, size);
+/*
+	Function name:		mincrypt_ctx_set_io_mode
+	Since version:		0.0.5
+	Description:		This function is used to set the way the files are read and written by the file encryption and decryption using the context. IO_MODE_MMAP maps the input file to memory and writes each chunk using pwrite(), IO_MODE_MMAP_RW maps the output file too. IO_MODE_URING keeps several reads and writes in flight using io_uring. All of them fall back to IO_MODE_READ if the input is not a regular file, the output is not seekable or the kernel doesn't support them
+	Arguments:		@ctx [context]: context to set the I/O mode for
+				@mode [int]: IO_MODE_READ, IO_MODE_MMAP, IO_MODE_MMAP_RW or IO_MODE_URING
+	Returns:		0 on success, -EINVAL for invalid mode, -ENOTSUP if mode is not supported on this platform
+*/
+DLLEXPORT int mincrypt_ctx_set_io_mode(mincrypt_ctx_t *ctx, int mode)
+{
+	if ((mode != IO_MODE_READ) && (mode != IO_MODE_MMAP) && (mode != IO_MODE_MMAP_RW) && (mode != IO_MODE_URING))
+		return -EINVAL;
 
-	if ((type_approach == APPROACH_ASYMMETRIC) && decrypt) {
-		shiftByte = asymmetric_decrypt_u64((uint64_t)abShift, (uint64_t)_iva[id % _avector_size], (uint64_t)_ivn[id % _avector_size]);
-	}
-	else
-	if ((type_approach == APPROACH_ASYMMETRIC) && !decrypt) {
-		srand( time(NULL) + crc );
-		shiftByte = (rand() + crc) % 256;
-		DPRINTF("%s: Generated a new shift byte = %d\n", __FUNCTION__, shiftByte);
+#ifdef WINDOWS
+	if (mode != IO_MODE_READ)
+		return -ENOTSUP;
+#endif
 
-		*abShift = asymmetric_encrypt_u64(shiftByte, (uint64_t)_iva[id % _avector_size], (uint64_t)_ivn[id % _avector_size]);
-	}
+	ctx->io_mode = mode;
+	return 0;
+}
 
-	for (i = 0; i < size; i++) {
-		if ((type_approach == APPROACH_ASYMMETRIC) && decrypt)
-			block[i] = shiftByte - block[i];
+/*
+	Function name:		mincrypt_set_io_mode
+	Since version:		0.0.5
+	Description:		This function is used to set the way the files are read and written by the file encryption and decryption, see mincrypt_ctx_set_io_mode()
+	Arguments:		@mode [int]: IO_MODE_READ, IO_MODE_MMAP, IO_MODE_MMAP_RW or IO_MODE_URING
+	Returns:		0 on success, -EINVAL for invalid mode, -ENOTSUP if mode is not supported on this platform
+*/
+DLLEXPORT int mincrypt_set_io_mode(int mode)
+{
+	return mincrypt_ctx_set_io_mode(&default_ctx, mode);
+}
 
-		out[i] = (_ival - crc - (_iv[i % _vector_size] << ((id * size) + i))) - block[i];
+/*
+	Function name:		mincrypt_ctx_set_direct
+	Since version:		0.0.5
+	Description:		This function is used to enable or disable direct I/O (O_DIRECT) for the file encryption and decryption using the context, so processing large files doesn't evict other data from the page cache. Direct I/O takes precedence over the I/O mode and threads. If the filesystem doesn't support O_DIRECT the page cache is used
+	Arguments:		@ctx [context]: context to set direct I/O for
+				@enable [int]: enable (1) or disable (0) direct I/O
+	Returns:		0 on success, -ENOTSUP if direct I/O is not supported on this platform
+*/
+DLLEXPORT int mincrypt_ctx_set_direct(mincrypt_ctx_t *ctx, int enable)
+{
+#ifndef O_DIRECT
+	if (enable)
+		return -ENOTSUP;
+#endif
 
-		if ((type_approach == APPROACH_ASYMMETRIC) && !decrypt)
-			out[i] = shiftByte - out[i];
-	}
+	ctx->direct = enable;
+	return 0;
+}
 
-	return out;
+/*
+	Function name:		mincrypt_set_direct
+	Since version:		0.0.5
+	Description:		This function is used to enable or disable direct I/O for the file encryption and decryption, see mincrypt_ctx_set_direct()
+	Arguments:		@enable [int]: enable (1) or disable (0) direct I/O
+	Returns:		0 on success, -ENOTSUP if direct I/O is not supported on this platform
+*/
+DLLEXPORT int mincrypt_set_direct(int enable)
+{
+	return mincrypt_ctx_set_direct(&default_ctx, enable);
 }
 
 /*
-	Function name:		mincrypt_encrypt
-	Since version:		0.0.1
-	Description:		Main function for the data encryption. Takes the block, size and id as input arguments with returning new size
-	Arguments:		@block [buffer]: buffer of data to be encrypted/decrypted
-				@size [int]: size of buffer
-				@id [int]: identifier of the chunk to be encoded
-				@new_size [size_t]: output integer value for the output buffer size
-	Returns:		output buffer of new_size bytes
+	Private function name:	autotune_benchmark
+	Since version:		0.0.5
+	Description:		This function is used to find the chunk size giving the best encryption throughput on this machine. Power of two sizes from the size of L1 data cache up to 4 MiB, i.e. beyond the size of the last level cache of most machines, are benchmarked by encrypting 4 MiB of data twice. Smallest size within 5 % of the best throughput is chosen as smaller chunks need less memory and have lower latency. Wall time of the monotonic clock is measured as CPU time would include other threads of the process
+	Arguments:		@out_type [int]: encoding type to benchmark
+	Returns:		chunk size, 0 if the benchmark cannot be run
 */
-DLLEXPORT unsigned char *mincrypt_encrypt(unsigned char *block, size_t size, int id, size_t *new_size)
+static size_t autotune_benchmark(int out_type)
 {
-	uint32_t crc = 0, abShift = 0;
-	uint64_t abShift64 = 0;
-	unsigned char *out = NULL, *tmp = NULL;
-	unsigned char data[4] = { 0 };
-	int csize = size;
+	mincrypt_ctx_t tmp = MINCRYPT_CTX_INITIALIZER;
+	unsigned char *in = NULL, *out = NULL;
+	size_t size, start = AUTOTUNE_MIN_SIZE, best = 0, outsize, pos, new_size;
+	double rate, best_rate = 0.0, rates[32];
+	int i, bits, num = 0, pass, id;
+	uint64_t t;
+
+	if (mincrypt_stats_clock() == 0)
+		return 0;
+
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+	DPRINTF("%s: Cache sizes: L1d %ld, L2 %ld, L3 %ld bytes\n", __FUNCTION__, sysconf(_SC_LEVEL1_DCACHE_SIZE),
+		sysconf(_SC_LEVEL2_CACHE_SIZE), sysconf(_SC_LEVEL3_CACHE_SIZE));
+
+	if ((sysconf(_SC_LEVEL1_DCACHE_SIZE) > AUTOTUNE_MIN_SIZE) && (sysconf(_SC_LEVEL1_DCACHE_SIZE) < AUTOTUNE_DATA_SIZE))
+		start = get_nearest_power_of_two(sysconf(_SC_LEVEL1_DCACHE_SIZE), &bits);
+#endif
 
-	if ((_iv == NULL) ||(((_iva == NULL) || (_ivn == NULL)) && (type_approach == APPROACH_ASYMMETRIC))) {
-		fprintf(stderr, "Error: Initialization vectors are not initialized\n");
-		if (new_size != NULL)
-			*new_size = -1;
-		return NULL;
-	}
+	tmp.out_type = out_type;
+	mincrypt_ctx_set_password(&tmp, "autotune", "autotune", -1);
 
-	crc = crc32_block(block, size, 0xFFFFFFFF);
-	DPRINTF("%s: Block CRC-32 value: 0x%"PRIx32"\n", __FUNCTION__, crc);
+	/* Output of all the chunks is kept to include the memory traffic of real files */
+	outsize = mincrypt_ctx_get_encrypted_size(&tmp, AUTOTUNE_DATA_SIZE) + (AUTOTUNE_DATA_SIZE / start) * (strlen(SIGNATURE) + 21);
+	if (((in = (unsigned char *)malloc( AUTOTUNE_DATA_SIZE * sizeof(unsigned char) )) == NULL)
+		|| ((out = (unsigned char *)malloc( outsize * sizeof(unsigned char) )) == NULL))
+		goto cleanup;
 
-	tmp = mincrypt_process(block, size, 0, crc, id, &abShift64);
-	if (tmp == NULL)
-		return NULL;
+	for (pos = 0; pos < AUTOTUNE_DATA_SIZE; pos++)
+		in[pos] = (unsigned char)((pos * 2654435761U) >> 13);
+
+	for (size = start; size <= AUTOTUNE_DATA_SIZE; size <<= 1) {
+		t = mincrypt_stats_clock();
+		for (pass = 0; pass < 2; pass++) {
+			pos = 0;
+			for (id = 0; id < AUTOTUNE_DATA_SIZE / size; id++) {
+				if (mincrypt_ctx_encrypt_into(&tmp, in + id * size, size, id + 1, out + pos, outsize - pos, &new_size) != 0)
+					goto cleanup;
+				pos += new_size;
+			}
+		}
+		t = mincrypt_stats_clock() - t;
 
-	abShift = (uint32_t)abShift64;
+		rate = (t > 0) ? (2.0 * AUTOTUNE_DATA_SIZE * 1000000000.0) / t : 0.0;
+		DPRINTF("%s: Chunk size %lu bytes: %.0f bytes per second\n", __FUNCTION__, (unsigned long)size, rate);
 
-	if (out_type == ENCODING_TYPE_BASE64) {
-		int siglen = 0;
-		int orig_size = (int) size;
-		unsigned char *tmp2 = NULL;
-
-		DPRINTF("%s: Original size is %d bytes\n", __FUNCTION__, orig_size);
-
-		tmp2 = (unsigned char *)base64_encode( (const char *)tmp, &size);
-		free(tmp);
-
-		DPRINTF("%s: Encoded size is %ld bytes\n", __FUNCTION__, (unsigned long)size);
-
-		siglen = strlen(SIGNATURE);
-		csize = size + 17 + siglen;
-
-                out = malloc( csize * sizeof(unsigned char) );
-                memset(out, 0, csize);
-
-		strncpy(out, SIGNATURE, siglen);
-                out[siglen+0] = out_type;
-                DPRINTF("%s: Saving out_type 0x%02x to chunk position 0\n", __FUNCTION__, out_type);
-                UINT32STR(data, (uint32_t)orig_size);
-                memcpy(out+siglen+1, data, 4);
-                DPRINTF("%s: Saving original size (%d) to chunk positions 1 - 4 after signature = { %02x, %02x, %02x, %02x }\n",
-                                __FUNCTION__, orig_size, out[1+siglen], out[2+siglen], out[3+siglen], out[4+siglen]);
-                UINT32STR(data, (uint32_t)size);
-                memcpy(out+siglen+5, data, 4);
-                DPRINTF("%s: Saving new size (%ld) to chunk positions 5 - 8 after signature = { %02x, %02x, %02x, %02x }\n",
-                                __FUNCTION__, (unsigned long)size, out[5+siglen], out[6+siglen], out[7+siglen], out[8+siglen]);
-		UINT32STR(data, (uint32_t)crc);
-		memcpy(out+siglen+9, data, 4);
-		DPRINTF("%s: Saving CRC (0x%"PRIx32") to chunk positions 9 - 12 after signature = { %02x, %02x, %02x, %02x }\n",
-				__FUNCTION__, crc, out[9+siglen], out[10+siglen], out[11+siglen], out[12+siglen]);
-		UINT32STR(data, (uint32_t)abShift);
-                memcpy(out+siglen+13, data, 4);
-		DPRINTF("%s: Saving abShift value (0x%"PRIx32") to chunk positions 13 - 16 after signature = { %02x, %02x, %02x, %02x}\n",
-				__FUNCTION__, abShift, out[13+siglen], out[14+siglen], out[15+siglen], out[16+siglen]);
-		memcpy(out+siglen+17, tmp2, size);
-
-                free(tmp2);
+		rates[num++] = rate;
+		if (rate > best_rate)
+			best_rate = rate;
 	}
-	else
-	if (out_type == ENCODING_TYPE_BINARY) {
-		int siglen = 0;
-
-		siglen = strlen(SIGNATURE);
-		csize = size + 17 + siglen;
-
-		out = malloc( csize * sizeof(unsigned char) );
-		memset(out, 0, csize);
-
-		strncpy(out, SIGNATURE, siglen);
-		out[siglen+0] = out_type;
-		DPRINTF("%s: Saving out_type 0x%02x to chunk position 0\n", __FUNCTION__, out_type);
-		UINT32STR(data, (uint32_t)size);
-		memcpy(out+siglen+1, data, 4);
-		DPRINTF("%s: Saving original size (%ld) to chunk positions 1 - 4 after signature = { %02x, %02x, %02x, %02x }\n",
-				__FUNCTION__, (unsigned long)size, out[1+siglen], out[2+siglen], out[3+siglen], out[4+siglen]);
-		DPRINTF("%s: Leaving positions 5 to 8 after signature empty since they are reserved\n", __FUNCTION__);
-		UINT32STR(data, (uint32_t)crc);
-		memcpy(out+siglen+9, data, 4);
-		DPRINTF("%s: Saving CRC (0x%"PRIx32") to chunk positions 9 - 12 after signature = { %02x, %02x, %02x, %02x }\n",
-				__FUNCTION__, crc, out[9+siglen], out[10+siglen], out[11+siglen], out[12+siglen]);
-
-		if (abShift > 0) {
-			UINT32STR(data, (uint32_t)abShift);
-			memcpy(out+siglen+13, data, 4);
-			DPRINTF("%s: Saving abShift value (0x%"PRIx32") to chunk positions 13 - 16 after signature = { %02x, %02x, %02x, %02x}\n",
-				__FUNCTION__, abShift, out[13+siglen], out[14+siglen], out[15+siglen], out[16+siglen]);
-		}
-		else {
-			memset(data, 0, 4);
-			memcpy(out+siglen+13, data, 4);
-			DPRINTF("%s: Leaving positions 13 to 17 empty since they are reserved\n", __FUNCTION__);
+
+	for (i = 0, size = start; i < num; i++, size <<= 1)
+		if (rates[i] >= best_rate * 0.95) {
+			best = size;
+			break;
 		}
 
-		DPRINTF("%s: Saving %ld bytes to the end of the stream\n", __FUNCTION__, (unsigned long)size);
-		memcpy(out+siglen+17, tmp, size);
+	DPRINTF("%s: Chunk size set to %lu bytes\n", __FUNCTION__, (unsigned long)best);
 
-		free(tmp);
-	}
+cleanup:
+	free(in);
+	free(out);
+	mincrypt_ctx_cleanup(&tmp);
+	return best;
+}
 
-	if (new_size != NULL) {
-		DPRINTF("%s: New size is %"PRIi32"\n", __FUNCTION__, csize);
-		*new_size = csize;
-	}
+#ifndef WINDOWS
+static pthread_mutex_t autotune_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
-	return out;
+/*
+	Private function name:	autotune_chunk_size
+	Since version:		0.0.5
+	Description:		This function is used to get the chunk size found by autotune_benchmark(). The result is computed once per encoding type, the lock makes contexts tuned by other threads at the same time wait for the result instead of benchmarking concurrently
+	Arguments:		@ctx [context]: context to tune the chunk size for, only its encoding type is used
+	Returns:		chunk size, BUFFER_SIZE if the benchmark cannot be run
+*/
+static size_t autotune_chunk_size(mincrypt_ctx_t *ctx)
+{
+	static size_t tuned[2] = { 0, 0 };
+	int b64 = (ctx->out_type == ENCODING_TYPE_BASE64);
+	size_t size;
+
+#ifndef WINDOWS
+	pthread_mutex_lock(&autotune_lock);
+#endif
+	if (tuned[b64] == 0)
+		tuned[b64] = autotune_benchmark(ctx->out_type);
+	size = tuned[b64];
+#ifndef WINDOWS
+	pthread_mutex_unlock(&autotune_lock);
+#endif
+
+	return (size != 0) ? size : BUFFER_SIZE;
 }
 
 /*
-	Function name:		mincrypt_decrypt
-	Since version:		0.0.1
-	Description:		Main function for the data decryption. Takes the block, size and id as input arguments with returning both decrypted encoded and decrypted decoded (raw) size
-	Arguments:		@block [buffer]: buffer of data to be encrypted/decrypted
-				@size [int]: size of buffer
-				@id [int]: identifier of the chunk to be encoded
-				@new_size [size_t]: output integer value for the output buffer size
-				@read_size [int]: output integer value for the decoded output buffer size (different from new_size in case of base64 encoding)
-	Returns:		output buffer of read_size bytes
+	Function name:		mincrypt_ctx_set_chunk_size
+	Since version:		0.0.5
+	Description:		This function is used to set the size of the plain data of the chunks of the files and streams encrypted using the context. Bigger chunks give better throughput for big files, smaller ones lower latency and memory usage. The size of every chunk is stored in its header so files using any chunk size can be decrypted regardless of this setting
+	Arguments:		@ctx [context]: context to set the chunk size for
+				@size [size_t]: chunk size in bytes between CHUNK_SIZE_MIN and CHUNK_SIZE_MAX, or CHUNK_SIZE_AUTO to benchmark the chunk sizes and use the fastest one
+	Returns:		0 on success, -EINVAL for invalid size
 */
-DLLEXPORT unsigned char *mincrypt_decrypt(unsigned char *block, size_t size, int id, size_t *new_size, int *read_size)
+DLLEXPORT int mincrypt_ctx_set_chunk_size(mincrypt_ctx_t *ctx, size_t size)
+{
+	if (size == CHUNK_SIZE_AUTO)
+		size = autotune_chunk_size(ctx);
+
+	if ((size < CHUNK_SIZE_MIN) || (size > CHUNK_SIZE_MAX))
+		return -EINVAL;
+
+	ctx->chunk_size = size;
+	return 0;
+}
+
+/*
+	Function name:		mincrypt_ctx_get_chunk_size
+	Since version:		0.0.5
+	Description:		This function is used to get the size of the plain data of the chunks of the files encrypted using the context
+	Arguments:		@ctx [context]: context to get the chunk size of
+	Returns:		chunk size in bytes
+*/
+DLLEXPORT size_t mincrypt_ctx_get_chunk_size(mincrypt_ctx_t *ctx)
+{
+	return ctx->chunk_size;
+}
+
+/*
+	Function name:		mincrypt_set_chunk_size
+	Since version:		0.0.5
+	Description:		This function is used to set the size of the plain data of the encrypted chunks, see mincrypt_ctx_set_chunk_size()
+	Arguments:		@size [size_t]: chunk size in bytes or CHUNK_SIZE_AUTO
+	Returns:		0 on success, -EINVAL for invalid size
+*/
+DLLEXPORT int mincrypt_set_chunk_size(size_t size)
+{
+	return mincrypt_ctx_set_chunk_size(&default_ctx, size);
+}
+
+/*
+	Function name:		mincrypt_get_chunk_size
+	Since version:		0.0.5
+	Description:		This function is used to get the size of the plain data of the encrypted chunks
+	Arguments:		None
+	Returns:		chunk size in bytes
+*/
+DLLEXPORT size_t mincrypt_get_chunk_size(void)
+{
+	return mincrypt_ctx_get_chunk_size(&default_ctx);
+}
+
+/*
+	Function name:		mincrypt_stats_clock
+	Since version:		0.0.5
+	Description:		This function is used to get the timestamp for the timing statistics. Monotonic clock is read using vDSO on Linux so it doesn't enter the kernel
+	Arguments:		None
+	Returns:		timestamp in nanoseconds, 0 if the clock is not available
+*/
+uint64_t mincrypt_stats_clock(void)
+{
+#ifndef WINDOWS
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+
+	return 0;
+}
+
+/*
+	Function name:		mincrypt_ctx_set_stats
+	Since version:		0.0.5
+	Description:		This function is used to enable or disable collection of the runtime statistics of the context. Counters are reset when the collection is enabled. Timing adds two clock readings per measured step so it's disabled by default
+	Arguments:		@ctx [context]: context to set the statistics collection for
+				@enable [int]: enable (1) or disable (0) the statistics
+	Returns:		0 on success
+*/
+DLLEXPORT int mincrypt_ctx_set_stats(mincrypt_ctx_t *ctx, int enable)
+{
+	if (enable)
+		memset(&ctx->stats, 0, sizeof(mincrypt_stats_t));
+
+	ctx->collect_stats = enable ? 1 : 0;
+	return 0;
+}
+
+/*
+	Function name:		mincrypt_ctx_get_stats
+	Since version:		0.0.5
+	Description:		This function is used to get the runtime statistics of the context collected since they have been enabled
+	Arguments:		@ctx [context]: context to get the statistics of
+				@stats [stats]: output variable for the statistics
+	Returns:		0 on success, -EINVAL if stats is NULL
+*/
+DLLEXPORT int mincrypt_ctx_get_stats(mincrypt_ctx_t *ctx, mincrypt_stats_t *stats)
+{
+	if (stats == NULL)
+		return -EINVAL;
+
+	memcpy(stats, &ctx->stats, sizeof(mincrypt_stats_t));
+	return 0;
+}
+
+/*
+	Function name:		mincrypt_set_stats
+	Since version:		0.0.5
+	Description:		This function is used to enable or disable collection of the runtime statistics, see mincrypt_ctx_set_stats()
+	Arguments:		@enable [int]: enable (1) or disable (0) the statistics
+	Returns:		0 on success
+*/
+DLLEXPORT int mincrypt_set_stats(int enable)
+{
+	return mincrypt_ctx_set_stats(&default_ctx, enable);
+}
+
+/*
+	Function name:		mincrypt_get_stats
+	Since version:		0.0.5
+	Description:		This function is used to get the runtime statistics collected since they have been enabled
+	Arguments:		@stats [stats]: output variable for the statistics
+	Returns:		0 on success, -EINVAL if stats is NULL
+*/
+DLLEXPORT int mincrypt_get_stats(mincrypt_stats_t *stats)
+{
+	return mincrypt_ctx_get_stats(&default_ctx, stats);
+}
+
+/*
+	Function name:		mincrypt_pread
+	Since version:		0.0.5
+	Description:		This function is used to decrypt the part of the encrypted file with the chunk index, see mincrypt_ctx_pread()
+	Arguments:		@fd [int]: file descriptor of the encrypted file
+				@buf [buffer]: buffer for the plain data
+				@len [size_t]: number of bytes to read
+				@offset [uint64_t]: offset in the plain data
+	Returns:		number of bytes read, -errno on error
+*/
+DLLEXPORT ssize_t mincrypt_pread(int fd, unsigned char *buf, size_t len, uint64_t offset)
+{
+	return mincrypt_ctx_pread(&default_ctx, fd, buf, len, offset);
+}
+
+/*
+	Function name:		mincrypt_stream_init
+	Since version:		0.0.5
+	Description:		This function is used to create a stream for encryption or decryption of input of any length using the default context, see mincrypt_ctx_stream_init()
+	Arguments:		@decrypt [int]: zero to encrypt, non-zero to decrypt
+				@write [callback]: function called with each block of the output, returning non-zero aborts the stream
+				@opaque [pointer]: value passed to the write callback
+	Returns:		new stream or NULL if cannot allocate memory
+*/
+DLLEXPORT mincrypt_stream_t *mincrypt_stream_init(int decrypt, tMincryptStreamWrite write, void *opaque)
+{
+	return mincrypt_ctx_stream_init(&default_ctx, decrypt, write, opaque);
+}
+
+/*
+	Function name:		mincrypt_set_password
+	Since version:		0.0.1
+	Description:		This function is used to calculate initialization vectors (IV) from the password and salt values
+	Arguments:		@salt [string]: salt value to be used for the IV generation
+				@password [string]: password to be used for IV generation
+				@vector_multiplier [int]: value to extend the vector by multiplicating it's size
+	Returns:		None
+*/
+DLLEXPORT void mincrypt_set_password(char *salt, char *password, int vector_multiplier)
+{
+	mincrypt_ctx_set_password(&default_ctx, salt, password, vector_multiplier);
+}
+
+/*
+	Function name:		mincrypt_cleanup
+	Since version:		0.0.1
+	Description:		This function is used to cleanup all the memory allocated by crypt_set_password() function
+	Arguments:		None
+	Returns:		None
+*/
+DLLEXPORT void mincrypt_cleanup(void)
+{
+	mincrypt_ctx_cleanup(&default_ctx);
+}
+
+/*
+	Private function name:	mincrypt_process_init
+	Since version:		0.0.5
+	Description:		This function is used to prepare the encryption or decryption of the data block. It selects the transformation for the approach and direction once per block, the block is then processed by cipher_key_apply() in parts small enough to stay in the CPU cache between the transformation and the CRC or base64 pass
+	Arguments:		@ctx [context]: context holding the initialization vectors
+				@key [key]: key stream to be initialized
+				@size [int]: size of the whole data block
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+				@crc [uint32_t]: CRC value for the data block (used as a part of algorithm)
+				@id [int]: identifier of the chunk to be encoded (used as a part of algorithm)
+				@abShift [uint64_t]: asymmetric block shift value, output for encryption and input for decryption
+	Returns:		0 for no error, -errno otherwise
+*/
+static int mincrypt_process_init(mincrypt_ctx_t *ctx, cipher_key_t *key, int size, int decrypt, uint32_t crc, int id, uint64_t *abShift)
+{
+	int shiftByte = 0, mode;
+	unsigned int seed;
+
+	if (ctx->iv == NULL) {
+		fprintf(stderr, "Error: Initialization vectors are not initialized\n");
+		return -EINVAL;
+	}
+
+	if ((ctx->type_approach == APPROACH_ASYMMETRIC) && (abShift == NULL)) {
+		DPRINTF("%s: Asymmetric approach requires abShift pointer to be non-null\n", __FUNCTION__);
+		return -EINVAL;
+	}
+
+	if (size <= 0) {
+		DPRINTF("%s: Invalid size of %d\n", __FUNCTION__, size);
+		return -EINVAL;
+	}
+
+	if (ctx->type_approach != APPROACH_ASYMMETRIC) {
+		mode = decrypt ? CIPHER_MODE_SYMMETRIC_DECRYPT : CIPHER_MODE_SYMMETRIC_ENCRYPT;
+	}
+	else
+	if (decrypt) {
+		mode = CIPHER_MODE_ASYMMETRIC_DECRYPT;
+		shiftByte = asymmetric_decrypt_u64(*abShift, (uint64_t)ctx->iva[id % ctx->avector_size], (uint64_t)ctx->ivn[id % ctx->avector_size]);
+	}
+	else {
+		mode = CIPHER_MODE_ASYMMETRIC_ENCRYPT;
+		/* Use reentrant generator as chunks may be encrypted by several threads */
+		seed = time(NULL) + crc;
+		shiftByte = (rand_r(&seed) + crc) % 256;
+		DPRINTF("%s: Generated a new shift byte = %d\n", __FUNCTION__, shiftByte);
+
+		*abShift = asymmetric_encrypt_u64(shiftByte, (uint64_t)ctx->iva[id % ctx->avector_size], (uint64_t)ctx->ivn[id % ctx->avector_size]);
+	}
+
+	cipher_key_init(key, ctx, size, crc, id, mode, (unsigned char)shiftByte);
+	return 0;
+}
+
+/*
+	Function name:		mincrypt_ctx_get_encrypted_size
+	Since version:		0.0.5
+	Description:		This function is used to get the size of the encrypted chunk including its header for the input block of size bytes using current encoding type of the context. It should be used to allocate the buffer for mincrypt_ctx_encrypt_into() function
+	Arguments:		@ctx [context]: context to be used for the encryption
+				@size [size_t]: size of input block
+	Returns:		size of the encrypted chunk in bytes
+*/
+DLLEXPORT size_t mincrypt_ctx_get_encrypted_size(mincrypt_ctx_t *ctx, size_t size)
+{
+	if (ctx->out_type == ENCODING_TYPE_BASE64)
+		size = base64_encoded_size(size);
+
+	return size + 17 + strlen(SIGNATURE);
+}
+
+/*
+	Function name:		mincrypt_get_encrypted_size
+	Since version:		0.0.5
+	Description:		This function is used to get the size of the encrypted chunk including its header for the input block of size bytes. It should be used to allocate the buffer for mincrypt_encrypt_into() function
+	Arguments:		@size [size_t]: size of input block
+	Returns:		size of the encrypted chunk in bytes
+*/
+DLLEXPORT size_t mincrypt_get_encrypted_size(size_t size)
+{
+	return mincrypt_ctx_get_encrypted_size(&default_ctx, size);
+}
+
+/*
+	Function name:		mincrypt_get_decrypted_size
+	Since version:		0.0.5
+	Description:		This function is used to get the size of the decrypted data of the encrypted chunk. It should be used to allocate the buffer for mincrypt_decrypt_into() function
+	Arguments:		@block [buffer]: encrypted chunk, only the header is being read
+				@size [size_t]: size of the buffer
+	Returns:		size of the decrypted data in bytes, 0 if block is not a valid encrypted chunk
+*/
+DLLEXPORT size_t mincrypt_get_decrypted_size(unsigned char *block, size_t size)
 {
-	unsigned char *signature = NULL;
-	unsigned char data[4] = { 0 }, *out = NULL;
-	uint32_t old_crc = 0, new_crc = 0;
-	uint32_t csize = size;
-	uint64_t abShift = 0;
-	unsigned int enc_size = 0, orig_size = 0;
 	int siglen = strlen(SIGNATURE);
-	int i;
 
-	if ((_iv == NULL) ||(((_iva == NULL) || (_ivn == NULL)) && (type_approach == APPROACH_ASYMMETRIC))) {
+	if ((size < siglen + 17) || (memcmp(block, SIGNATURE, siglen) != 0))
+		return 0;
+
+	return GETUINT32((block + siglen + 1));
+}
+
+/*
+	Function name:		mincrypt_ctx_encrypt_into
+	Since version:		0.0.5
+	Description:		Function for the data encryption into the buffer provided by the caller. Unlike mincrypt_ctx_encrypt() it doesn't allocate any memory, the header and encrypted data are written directly to the output buffer
+	Arguments:		@ctx [context]: context to be used for the encryption
+				@block [buffer]: buffer of data to be encrypted
+				@size [size_t]: size of buffer
+				@id [int]: identifier of the chunk to be encoded
+				@out [buffer]: output buffer, must not overlap with block
+				@out_size [size_t]: size of output buffer, see mincrypt_ctx_get_encrypted_size()
+				@new_size [size_t]: output value for the number of bytes written to out, may be NULL
+	Returns:		0 for no error, -ENOSPC if output buffer is too small, -errno otherwise
+*/
+DLLEXPORT int mincrypt_ctx_encrypt_into(mincrypt_ctx_t *ctx, unsigned char *block, size_t size, int id, unsigned char *out, size_t out_size, size_t *new_size)
+{
+	uint32_t crc = 0, abShift = 0;
+	uint64_t abShift64 = 0, t;
+	unsigned char tile[PROCESS_TILE_SIZE];
+	unsigned char *payload = NULL;
+	size_t csize, off, len, enc_size = 0;
+	int siglen = strlen(SIGNATURE);
+	int ret;
+	cipher_key_t key;
+
+	if ((ctx->iv == NULL) ||(((ctx->iva == NULL) || (ctx->ivn == NULL)) && (ctx->type_approach == APPROACH_ASYMMETRIC))) {
 		fprintf(stderr, "Error: Initialization vectors are not initialized\n");
-		if (new_size != NULL)
-			*new_size = -1;
+		return -EINVAL;
+	}
+
+	csize = mincrypt_ctx_get_encrypted_size(ctx, size);
+	if (out_size < csize) {
+		DPRINTF("%s: Output buffer of %ld bytes is too small, %ld bytes required\n", __FUNCTION__,
+				(unsigned long)out_size, (unsigned long)csize);
+		return -ENOSPC;
+	}
+
+	t = STATS_START(ctx);
+	crc = crc32_block(block, size, 0xFFFFFFFF);
+	STATS_STOP(ctx, ns_crc, t);
+	DPRINTF("%s: Block CRC-32 value: 0x%"PRIx32"\n", __FUNCTION__, crc);
+
+	if ((ret = mincrypt_process_init(ctx, &key, size, 0, crc, id, &abShift64)) != 0)
+		return ret;
+
+	abShift = (uint32_t)abShift64;
+
+	payload = out + siglen + 17;
+	if (ctx->out_type == ENCODING_TYPE_BASE64) {
+		DPRINTF("%s: Original size is %ld bytes\n", __FUNCTION__, (unsigned long)size);
+		/* Encrypt a tile into cache-resident buffer and encode it while it's still hot */
+		for (off = 0; off < size; off += len) {
+			len = (size - off < PROCESS_TILE_SIZE) ? size - off : PROCESS_TILE_SIZE;
+			t = STATS_START(ctx);
+			cipher_key_apply(&key, tile, block + off, off, len);
+			STATS_STOP(ctx, ns_cipher, t);
+
+			t = STATS_START(ctx);
+			enc_size += base64_encode_buffer(payload + enc_size, tile, len);
+			STATS_STOP(ctx, ns_base64, t);
+		}
+		DPRINTF("%s: Encoded size is %ld bytes\n", __FUNCTION__, (unsigned long)enc_size);
+	}
+	else {
+		/*
+		 * Not tiled: the key depends on CRC-32 of the whole chunk so the checksum pass has to be
+		 * finished first, and the remaining single pass streams from block to payload with no
+		 * intermediate buffer to keep in the cache
+		 */
+		t = STATS_START(ctx);
+		cipher_key_apply(&key, payload, block, 0, size);
+		STATS_STOP(ctx, ns_cipher, t);
+	}
+
+	memcpy(out, SIGNATURE, siglen);
+	out[siglen+0] = ctx->out_type;
+	DPRINTF("%s: Saving out_type 0x%02x to chunk position 0\n", __FUNCTION__, ctx->out_type);
+	UINT32STR((out + siglen + 1), (uint32_t)size);
+	DPRINTF("%s: Saving original size (%ld) to chunk positions 1 - 4 after signature\n", __FUNCTION__, (unsigned long)size);
+	/* Positions 5 to 8 are reserved (zero) for binary encoding */
+	UINT32STR((out + siglen + 5), (uint32_t)enc_size);
+	DPRINTF("%s: Saving new size (%ld) to chunk positions 5 - 8 after signature\n", __FUNCTION__, (unsigned long)enc_size);
+	UINT32STR((out + siglen + 9), crc);
+	DPRINTF("%s: Saving CRC (0x%"PRIx32") to chunk positions 9 - 12 after signature\n", __FUNCTION__, crc);
+	UINT32STR((out + siglen + 13), abShift);
+	DPRINTF("%s: Saving abShift value (0x%"PRIx32") to chunk positions 13 - 16 after signature\n", __FUNCTION__, abShift);
+
+	if (new_size != NULL) {
+		DPRINTF("%s: New size is %ld\n", __FUNCTION__, (unsigned long)csize);
+		*new_size = csize;
+	}
+
+	STATS_ADD(ctx, chunks, 1);
+	STATS_ADD(ctx, bytes_in, size);
+	STATS_ADD(ctx, bytes_out, csize);
+
+	return 0;
+}
+
+/*
+	Function name:		mincrypt_encrypt_into
+	Since version:		0.0.5
+	Description:		Function for the data encryption into the buffer provided by the caller. Unlike mincrypt_encrypt() it doesn't allocate any memory, the header and encrypted data are written directly to the output buffer
+	Arguments:		@block [buffer]: buffer of data to be encrypted
+				@size [size_t]: size of buffer
+				@id [int]: identifier of the chunk to be encoded
+				@out [buffer]: output buffer, must not overlap with block
+				@out_size [size_t]: size of output buffer, see mincrypt_get_encrypted_size()
+				@new_size [size_t]: output value for the number of bytes written to out, may be NULL
+	Returns:		0 for no error, -ENOSPC if output buffer is too small, -errno otherwise
+*/
+DLLEXPORT int mincrypt_encrypt_into(unsigned char *block, size_t size, int id, unsigned char *out, size_t out_size, size_t *new_size)
+{
+	return mincrypt_ctx_encrypt_into(&default_ctx, block, size, id, out, out_size, new_size);
+}
+
+/*
+	Function name:		mincrypt_ctx_encrypt
+	Since version:		0.0.5
+	Description:		Main function for the data encryption using the context. Takes the block, size and id as input arguments with returning new size
+	Arguments:		@ctx [context]: context to be used for the encryption
+				@block [buffer]: buffer of data to be encrypted/decrypted
+				@size [int]: size of buffer
+				@id [int]: identifier of the chunk to be encoded
+				@new_size [size_t]: output integer value for the output buffer size
+	Returns:		output buffer of new_size bytes
+*/
+DLLEXPORT unsigned char *mincrypt_ctx_encrypt(mincrypt_ctx_t *ctx, unsigned char *block, size_t size, int id, size_t *new_size)
+{
+	unsigned char *out = NULL;
+	size_t csize;
+
+	csize = mincrypt_ctx_get_encrypted_size(ctx, size);
+	out = (unsigned char *)malloc( csize * sizeof(unsigned char) );
+	if (out == NULL) {
+		DPRINTF("%s: Cannot allocate %ld bytes of memory\n", __FUNCTION__, (unsigned long)csize);
 		return NULL;
 	}
+	STATS_ADD(ctx, allocations, 1);
 
-	if (size == 0) {
+	if (mincrypt_ctx_encrypt_into(ctx, block, size, id, out, csize, new_size) != 0) {
+		free(out);
 		if (new_size != NULL)
 			*new_size = -1;
 		return NULL;
 	}
 
-	signature = malloc( (siglen+1) * sizeof(char));
-	memset(signature, 0, siglen+1);
-	for (i = 0; i < siglen; i++)
-		signature[i] = block[i];
-	if (strcmp(signature, SIGNATURE) != 0) {
-		fprintf(stderr, "Error: Block is not a valid mincrypt encrypted block (expected '%s' but '%s' found)\n",
-			SIGNATURE, signature);
-		free(signature);
-		return NULL;
+	return out;
+}
+
+/*
+	Function name:		mincrypt_encrypt
+	Since version:		0.0.1
+	Description:		Main function for the data encryption. Takes the block, size and id as input arguments with returning new size
+	Arguments:		@block [buffer]: buffer of data to be encrypted/decrypted
+				@size [int]: size of buffer
+				@id [int]: identifier of the chunk to be encoded
+				@new_size [size_t]: output integer value for the output buffer size
+	Returns:		output buffer of new_size bytes
+*/
+DLLEXPORT unsigned char *mincrypt_encrypt(unsigned char *block, size_t size, int id, size_t *new_size)
+{
+	return mincrypt_ctx_encrypt(&default_ctx, block, size, id, new_size);
+}
+
+/*
+	Function name:		mincrypt_ctx_decrypt_into
+	Since version:		0.0.5
+	Description:		Function for the data decryption into the buffer provided by the caller. Unlike mincrypt_ctx_decrypt() it doesn't allocate any memory, the decrypted data are written directly to the output buffer
+	Arguments:		@ctx [context]: context to be used for the decryption
+				@block [buffer]: buffer with the encrypted chunk
+				@size [size_t]: size of buffer
+				@id [int]: identifier of the chunk to be decoded
+				@out [buffer]: output buffer, must not overlap with block
+				@out_size [size_t]: size of output buffer, see mincrypt_get_decrypted_size()
+				@new_size [size_t]: output value for the number of bytes written to out, may be NULL
+				@read_size [int]: output value for the size of the encoded payload of the chunk, may be NULL
+	Returns:		0 for no error, -ENOSPC if output buffer is too small, -EINVAL for invalid chunk or CRC mismatch, -errno otherwise
+*/
+DLLEXPORT int mincrypt_ctx_decrypt_into(mincrypt_ctx_t *ctx, unsigned char *block, size_t size, int id, unsigned char *out, size_t out_size, size_t *new_size, int *read_size)
+{
+	uint32_t old_crc = 0, new_crc = 0;
+	uint64_t abShift = 0, t;
+	unsigned int enc_size = 0, orig_size = 0, off, len;
+	unsigned char *payload = NULL;
+	int siglen = strlen(SIGNATURE);
+	int out_type, ret;
+	cipher_key_t key;
+
+	if ((ctx->iv == NULL) ||(((ctx->iva == NULL) || (ctx->ivn == NULL)) && (ctx->type_approach == APPROACH_ASYMMETRIC))) {
+		fprintf(stderr, "Error: Initialization vectors are not initialized\n");
+		return -EINVAL;
+	}
+
+	if (size < siglen + 17) {
+		DPRINTF("%s: Block of %ld bytes is too small to hold chunk header\n", __FUNCTION__, (unsigned long)size);
+		return -EINVAL;
+	}
+
+	if (memcmp(block, SIGNATURE, siglen) != 0) {
+		fprintf(stderr, "Error: Block is not a valid mincrypt encrypted block (expected '%s' but '%.*s' found)\n",
+			SIGNATURE, siglen, block);
+		return -EINVAL;
 	}
-	free(signature);
 
 	DPRINTF("%s: Signature match. Going on...\n", __FUNCTION__);
 
@@ -932,87 +1565,185 @@ DLLEXPORT unsigned char *mincrypt_decrypt(unsigned char *block, size_t size, int
 	DPRINTF("%s: Found type 0x%02x [%s]\n", __FUNCTION__, out_type, (out_type == ENCODING_TYPE_BASE64) ? "base64" : "binary" );
 	DPRINTF("%s: Input size is %ld\n", __FUNCTION__, (unsigned long)size);
 
-	data[0] = block[siglen+1];
-	data[1] = block[siglen+2];
-	data[2] = block[siglen+3];
-	data[3] = block[siglen+4];
-	orig_size = GETUINT32(data);
+	orig_size = GETUINT32((block + siglen + 1));
 	DPRINTF("%s: Original chunk size is %d bytes\n", __FUNCTION__, orig_size);
 
-	data[0] = block[siglen+5];
-	data[1] = block[siglen+6];
-	data[2] = block[siglen+7];
-	data[3] = block[siglen+8];
-	enc_size = GETUINT32(data);
-	DPRINTF("%s: Encoded chunk size is %ld bytes\n", __FUNCTION__, (unsigned long)size);
-
-	data[0] = block[siglen+9];
-	data[1] = block[siglen+10];
-	data[2] = block[siglen+11];
-	data[3] = block[siglen+12];
-	old_crc = GETUINT32(data);
+	enc_size = GETUINT32((block + siglen + 5));
+	DPRINTF("%s: Encoded chunk size is %d bytes\n", __FUNCTION__, enc_size);
+
+	old_crc = GETUINT32((block + siglen + 9));
 	DPRINTF("%s: Original CRC-32 value is 0x%"PRIx32"\n", __FUNCTION__, old_crc);
 
-	data[0] = block[siglen+13];
-	data[1] = block[siglen+14];
-	data[2] = block[siglen+15];
-	data[3] = block[siglen+16];
-	abShift = (uint64_t)GETUINT32(data);
+	abShift = (uint64_t)GETUINT32((block + siglen + 13));
 	if (abShift > 0)
 		DPRINTF("%s: Asymmetric block shift value for decryption is 0x%"PRIx64"\n", __FUNCTION__, abShift);
 	else
 		DPRINTF("%s: No asymmetric block shift value set for decryption. Asymmetric approach not used\n", __FUNCTION__);
 
-	if (out_type == ENCODING_TYPE_BINARY) {
-		out = mincrypt_process(block+17+siglen, orig_size, 1, old_crc, id, abShift);
-		if (out == NULL)
-			return NULL;
+	if (out_size < orig_size) {
+		DPRINTF("%s: Output buffer of %ld bytes is too small, %d bytes required\n", __FUNCTION__,
+				(unsigned long)out_size, orig_size);
+		return -ENOSPC;
+	}
 
-		csize = orig_size;
+	if ((out_type != ENCODING_TYPE_BINARY) && (out_type != ENCODING_TYPE_BASE64)) {
+		DPRINTF("%s: Unsupported encoding type 0x%02x\n", __FUNCTION__, out_type);
+		return -EINVAL;
 	}
-	else
-	if (out_type == ENCODING_TYPE_BASE64) {
-		unsigned char *tmp = NULL;
 
-		tmp = (unsigned char *)base64_decode( (const char *)block+17+siglen, &size);
-		tmp[ orig_size ] = 0;
+	if ((out_type == ENCODING_TYPE_BASE64) && (enc_size != base64_encoded_size(orig_size))) {
+		DPRINTF("%s: Encoded size doesn't match the original size\n", __FUNCTION__);
+		return -EINVAL;
+	}
 
-		out = mincrypt_process(tmp, orig_size, 1, old_crc, id, abShift);
-		if (out == NULL)
-			return NULL;
+	if (size < (size_t)(siglen + 17) + ((out_type == ENCODING_TYPE_BASE64) ? enc_size : orig_size)) {
+		DPRINTF("%s: Block of %ld bytes is too small to hold chunk payload\n", __FUNCTION__, (unsigned long)size);
+		return -EINVAL;
+	}
 
-		csize = orig_size;
+	if ((ret = mincrypt_process_init(ctx, &key, orig_size, 1, old_crc, id, &abShift)) != 0)
+		return ret;
+
+	/*
+	 * Decode, decrypt and checksum the chunk tile by tile so each byte of the output
+	 * is read from the cache by the CRC calculation right after it has been written
+	 */
+	payload = block + siglen + 17;
+	new_crc = 0xFFFFFFFF;
+	for (off = 0; off < orig_size; off += len) {
+		len = (orig_size - off < PROCESS_TILE_SIZE) ? orig_size - off : PROCESS_TILE_SIZE;
+
+		if (out_type == ENCODING_TYPE_BASE64) {
+			t = STATS_START(ctx);
+			if (base64_decode_buffer(out + off, payload + (off / 3) * 4, base64_encoded_size(len)) != len) {
+				DPRINTF("%s: Cannot decode base64 encoded chunk\n", __FUNCTION__);
+				return -EINVAL;
+			}
+			STATS_STOP(ctx, ns_base64, t);
+
+			t = STATS_START(ctx);
+			cipher_key_apply(&key, out + off, out + off, off, len);
+			STATS_STOP(ctx, ns_cipher, t);
+		}
+		else {
+			t = STATS_START(ctx);
+			cipher_key_apply(&key, out + off, payload + off, off, len);
+			STATS_STOP(ctx, ns_cipher, t);
+		}
+
+		if (!ctx->simple_mode) {
+			t = STATS_START(ctx);
+			new_crc = crc32_block(out + off, len, new_crc);
+			STATS_STOP(ctx, ns_crc, t);
+		}
 	}
 
-	DPRINTF("%s: Got chunk size of %d bytes\n", __FUNCTION__, csize);
-	if (!simple_mode) {
-		new_crc = crc32_block(out, orig_size, 0xFFFFFFFF);
+	DPRINTF("%s: Got chunk size of %d bytes\n", __FUNCTION__, orig_size);
+	if (!ctx->simple_mode) {
 		DPRINTF("%s: Checking CRC value for %d byte-block (0x%08"PRIx32" [expected] %c= 0x%08"PRIx32" [found])\n",
 				__FUNCTION__, orig_size, old_crc, old_crc == new_crc ? '=' : '!', new_crc);
 
 		if (old_crc != new_crc) {
-			free(out);
-			if (new_size != NULL)
-				*new_size = -1;
-
 			DPRINTF("%s: CRC value doesn't match!\n", __FUNCTION__);
-			return NULL;
+			STATS_ADD(ctx, crc_failures, 1);
+			return -EINVAL;
 		}
 	}
 	else
 		DPRINTF("Ignoring original CRC-32 value since simple mode is on\n");
 
 	if (new_size != NULL) {
-		DPRINTF("Setting new size to %d bytes\n", csize);
-		*new_size = csize;
+		DPRINTF("Setting new size to %d bytes\n", orig_size);
+		*new_size = orig_size;
+	}
+
+	if (read_size != NULL)
+		*read_size = (enc_size > 0) ? enc_size : orig_size;
+
+	STATS_ADD(ctx, chunks, 1);
+	STATS_ADD(ctx, bytes_in, siglen + 17 + ((enc_size > 0) ? enc_size : orig_size));
+	STATS_ADD(ctx, bytes_out, orig_size);
+	return 0;
+}
+
+/*
+	Function name:		mincrypt_decrypt_into
+	Since version:		0.0.5
+	Description:		Function for the data decryption into the buffer provided by the caller. Unlike mincrypt_decrypt() it doesn't allocate any memory, the decrypted data are written directly to the output buffer
+	Arguments:		@block [buffer]: buffer with the encrypted chunk
+				@size [size_t]: size of buffer
+				@id [int]: identifier of the chunk to be decoded
+				@out [buffer]: output buffer, must not overlap with block
+				@out_size [size_t]: size of output buffer, see mincrypt_get_decrypted_size()
+				@new_size [size_t]: output value for the number of bytes written to out, may be NULL
+				@read_size [int]: output value for the size of the encoded payload of the chunk, may be NULL
+	Returns:		0 for no error, -ENOSPC if output buffer is too small, -EINVAL for invalid chunk or CRC mismatch, -errno otherwise
+*/
+DLLEXPORT int mincrypt_decrypt_into(unsigned char *block, size_t size, int id, unsigned char *out, size_t out_size, size_t *new_size, int *read_size)
+{
+	return mincrypt_ctx_decrypt_into(&default_ctx, block, size, id, out, out_size, new_size, read_size);
+}
+
+/*
+	Function name:		mincrypt_ctx_decrypt
+	Since version:		0.0.5
+	Description:		Main function for the data decryption using the context. Takes the block, size and id as input arguments with returning both decrypted encoded and decrypted decoded (raw) size
+	Arguments:		@ctx [context]: context to be used for the decryption
+				@block [buffer]: buffer of data to be encrypted/decrypted
+				@size [int]: size of buffer
+				@id [int]: identifier of the chunk to be encoded
+				@new_size [size_t]: output integer value for the output buffer size
+				@read_size [int]: output integer value for the decoded output buffer size (different from new_size in case of base64 encoding)
+	Returns:		output buffer of read_size bytes
+*/
+DLLEXPORT unsigned char *mincrypt_ctx_decrypt(mincrypt_ctx_t *ctx, unsigned char *block, size_t size, int id, size_t *new_size, int *read_size)
+{
+	unsigned char *out = NULL;
+	size_t osize;
+
+	osize = mincrypt_get_decrypted_size(block, size);
+	if (osize == 0) {
+		if (size > 0)
+			fprintf(stderr, "Error: Block is not a valid mincrypt encrypted block\n");
+		if (new_size != NULL)
+			*new_size = -1;
+		return NULL;
+	}
+
+	out = (unsigned char *)malloc( (osize + 1) * sizeof(unsigned char) );
+	if (out == NULL) {
+		DPRINTF("%s: Cannot allocate %ld bytes of memory\n", __FUNCTION__, (unsigned long)osize + 1);
+		return NULL;
+	}
+	STATS_ADD(ctx, allocations, 1);
+
+	if (mincrypt_ctx_decrypt_into(ctx, block, size, id, out, osize, new_size, read_size) != 0) {
+		free(out);
+		if (new_size != NULL)
+			*new_size = -1;
+		return NULL;
 	}
-
-	if (read_size != NULL)
-		*read_size = (enc_size > 0) ? enc_size : csize;
+	out[osize] = 0;
 
 	return out;
 }
 
+/*
+	Function name:		mincrypt_decrypt
+	Since version:		0.0.1
+	Description:		Main function for the data decryption. Takes the block, size and id as input arguments with returning both decrypted encoded and decrypted decoded (raw) size
+	Arguments:		@block [buffer]: buffer of data to be encrypted/decrypted
+				@size [int]: size of buffer
+				@id [int]: identifier of the chunk to be encoded
+				@new_size [size_t]: output integer value for the output buffer size
+				@read_size [int]: output integer value for the decoded output buffer size (different from new_size in case of base64 encoding)
+	Returns:		output buffer of read_size bytes
+*/
+DLLEXPORT unsigned char *mincrypt_decrypt(unsigned char *block, size_t size, int id, size_t *new_size, int *read_size)
+{
+	return mincrypt_ctx_decrypt(&default_ctx, block, size, id, new_size, read_size);
+}
+
 /*
 	Function name:		mincrypt_encrypt_minimal
 	Since version:		0.0.5
@@ -1143,24 +1874,368 @@ DLLEXPORT char *mincrypt_decrypt_minimal(char *input, unsigned char *key, unsign
 }
 
 /*
-	Function name:		mincrypt_encrypt_file
-	Since version:		0.0.1
-	Description:		Function for the entire file encryption. Takes the input and output files, salt, password and vector_multiplier value
-	Arguments:		@filename1 [string]: input (original) file
+	Private function name:	write_full
+	Since version:		0.0.5
+	Description:		This function is used to write the whole buffer to the file, retrying on short writes
+	Arguments:		@ctx [context]: context to account the time spent writing to
+				@fd [int]: file descriptor to write to
+				@data [buffer]: data to be written
+				@size [size_t]: size of data
+	Returns:		0 on success, -errno on error
+*/
+static int write_full(mincrypt_ctx_t *ctx, int fd, unsigned char *data, size_t size)
+{
+	uint64_t t = STATS_START(ctx);
+	ssize_t rc;
+
+	while (size > 0) {
+		rc = write(fd, data, size);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		data += rc;
+		size -= rc;
+	}
+
+	STATS_STOP(ctx, ns_io, t);
+	return 0;
+}
+
+/*
+	Private function name:	set_direct_io
+	Since version:		0.0.5
+	Description:		This function is used to enable or disable O_DIRECT for the open file
+	Arguments:		@fd [int]: file descriptor
+				@enable [int]: enable (1) or disable (0) O_DIRECT
+	Returns:		0 on success, -errno on error (-EINVAL if the filesystem doesn't support O_DIRECT)
+*/
+static int set_direct_io(int fd, int enable)
+{
+#ifdef O_DIRECT
+	int flags;
+
+	if ((flags = fcntl(fd, F_GETFL)) < 0)
+		return -errno;
+
+	if (fcntl(fd, F_SETFL, enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT)) < 0)
+		return -errno;
+
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+/*
+	Private function name:	file_sink_write
+	Since version:		0.0.5
+	Description:		This function is used as the write callback of the stream writing the output to the file. For direct I/O the output is collected to whole aligned blocks first
+	Arguments:		@opaque [sink]: output file of the stream
+				@data [buffer]: data to be written
+				@size [size_t]: size of data
+	Returns:		0 on success, -errno on error
+*/
+static int file_sink_write(void *opaque, unsigned char *data, size_t size)
+{
+	tFileSink *sink = (tFileSink *)opaque;
+	size_t len;
+	int rc;
+
+	sink->total += size;
+	if (sink->buf == NULL)
+		return write_full(sink->ctx, sink->fd, data, size);
+
+	while (size > 0) {
+		len = (size < DECRYPT_READ_SIZE - sink->len) ? size : DECRYPT_READ_SIZE - sink->len;
+		memcpy(sink->buf + sink->len, data, len);
+		sink->len += len;
+		data += len;
+		size -= len;
+
+		if (sink->len == DECRYPT_READ_SIZE) {
+			if ((rc = write_full(sink->ctx, sink->fd, sink->buf, sink->len)) != 0)
+				return rc;
+			sink->len = 0;
+		}
+	}
+
+	return 0;
+}
+
+/*
+	Private function name:	file_sink_flush
+	Since version:		0.0.5
+	Description:		This function is used to write the rest of the output collected for direct I/O. The tail which is not a whole block is written through the page cache
+	Arguments:		@sink [sink]: output file of the stream
+	Returns:		0 on success, -errno on error
+*/
+static int file_sink_flush(tFileSink *sink)
+{
+	int ret;
+
+	if ((sink->buf == NULL) || (sink->len == 0))
+		return 0;
+
+	if (sink->len % DIRECT_IO_ALIGN)
+		set_direct_io(sink->fd, 0);
+
+	ret = write_full(sink->ctx, sink->fd, sink->buf, sink->len);
+	sink->len = 0;
+	return ret;
+}
+
+/*
+	Private function name:	alloc_io_buffer
+	Since version:		0.0.5
+	Description:		This function is used to allocate the buffer for the blocks read or written by the file functions, aligned for direct I/O if requested
+	Arguments:		@ctx [context]: context to account the allocation to
+				@direct [int]: boolean whether the buffer is used for direct I/O
+	Returns:		new buffer of DECRYPT_READ_SIZE bytes or NULL if cannot allocate memory
+*/
+static unsigned char *alloc_io_buffer(mincrypt_ctx_t *ctx, int direct)
+{
+	void *buf = NULL;
+
+	STATS_ADD(ctx, allocations, 1);
+#ifndef WINDOWS
+	if (direct)
+		return (posix_memalign(&buf, DIRECT_IO_ALIGN, DECRYPT_READ_SIZE) == 0) ? (unsigned char *)buf : NULL;
+#endif
+
+	buf = malloc( DECRYPT_READ_SIZE * sizeof(unsigned char) );
+	return (unsigned char *)buf;
+}
+
+/*
+	Private function name:	process_fd_stream
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the whole input file by reading large blocks and passing them to the stream which splits them to chunks in memory, so no byte is read twice and the input doesn't have to be seekable. For direct I/O all the blocks read and written are aligned, only the tails are transferred through the page cache
+	Arguments:		@ctx [context]: context to be used for the processing
+				@fd [int]: input file descriptor
+				@fdOut [int]: output file descriptor
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+				@direct [int]: boolean whether the files are open for direct I/O
+				@total [uint64_t]: output variable for the number of bytes written, may be NULL
+	Returns:		0 for no error, error code otherwise
+*/
+static int process_fd_stream(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, int direct, uint64_t *total)
+{
+	mincrypt_stream_t *stream = NULL;
+	unsigned char *buf = NULL;
+	tFileSink sink;
+	int rc, ret = 0;
+	uint64_t t;
+
+	memset(&sink, 0, sizeof(sink));
+	sink.ctx = ctx;
+	sink.fd = fdOut;
+	if (((buf = alloc_io_buffer(ctx, direct)) == NULL) || (direct && ((sink.buf = alloc_io_buffer(ctx, direct)) == NULL))
+		|| ((stream = mincrypt_ctx_stream_init(ctx, decrypt, file_sink_write, &sink)) == NULL))
+		ret = -ENOMEM;
+
+	while (ret == 0) {
+		t = STATS_START(ctx);
+		rc = read(fd, buf, DECRYPT_READ_SIZE);
+		STATS_STOP(ctx, ns_io, t);
+		if (rc == 0)
+			break;
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -errno;
+			break;
+		}
+
+		/* File position is not aligned after a short read any more */
+		if (direct && (rc < DECRYPT_READ_SIZE))
+			set_direct_io(fd, 0);
+
+		ret = mincrypt_stream_update(stream, buf, rc);
+	}
+
+	if (stream != NULL) {
+		rc = mincrypt_stream_final(stream);
+		if (ret == 0)
+			ret = rc;
+	}
+
+	if (ret == 0)
+		ret = file_sink_flush(&sink);
+
+	free(buf);
+	free(sink.buf);
+
+	if (total != NULL)
+		*total = sink.total;
+
+	return ret;
+}
+
+#ifndef WINDOWS
+/*
+	Private function name:	fd_positional
+	Since version:		0.0.5
+	Description:		This function is used to check whether the positional I/O can be used for the descriptors. The I/O modes and the parallel decryption address the data from the beginning of the files so they cannot be used for pipes, sockets or descriptors already read or written by the caller
+	Arguments:		@fd [int]: input file descriptor
+				@fdOut [int]: output file descriptor
+	Returns:		1 if positional I/O can be used, 0 otherwise
+*/
+static int fd_positional(int fd, int fdOut)
+{
+	return (lseek(fd, 0, SEEK_CUR) == 0) && (lseek(fdOut, 0, SEEK_CUR) == 0);
+}
+
+/*
+	Private function name:	process_fd_io_mode
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the whole input file using the I/O mode of the context
+	Arguments:		@ctx [context]: context to be used for the processing
+				@fd [int]: input file descriptor
+				@fdOut [int]: output file descriptor
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+				@total [uint64_t]: output variable for the number of bytes of plain data, may be NULL
+	Returns:		0 for no error, -ENOTSUP if read and write has to be used, -errno otherwise
+*/
+static int process_fd_io_mode(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, uint64_t *total)
+{
+	switch (ctx->io_mode) {
+		case IO_MODE_MMAP:
+		case IO_MODE_MMAP_RW:
+			return mincrypt_mmap_process_fd(ctx, fd, fdOut, decrypt, ctx->threads, total);
+		case IO_MODE_URING:
+			return mincrypt_uring_process_fd(ctx, fd, fdOut, decrypt, total);
+	}
+
+	return -ENOTSUP;
+}
+#endif
+
+/*
+	Function name:		mincrypt_ctx_encrypt_fd
+	Since version:		0.0.5
+	Description:		Function for the encryption of all the data read from the input file descriptor into the output file descriptor using the context. Any descriptors are supported including pipes and sockets, the I/O mode is used only if both of them are seekable files. The IVs have to be set already and the descriptors are not closed
+	Arguments:		@ctx [context]: context to be used for the encryption
+				@fd [int]: input (original) file descriptor
+				@fdOut [int]: output (encrypted) file descriptor
+	Returns:		0 for no error, otherwise error code
+*/
+DLLEXPORT int mincrypt_ctx_encrypt_fd(mincrypt_ctx_t *ctx, int fd, int fdOut)
+{
+	unsigned char *buf = NULL, *outbuf = NULL;
+	int rc, id, ret = 0, errno_saved;
+	size_t outsize;
+	uint64_t t;
+	tChunkIndex idx;
+
+	/* Direct I/O needs aligned transfers which are done by the stream only */
+	if (ctx->direct) {
+		if ((set_direct_io(fd, 1) != 0) || (set_direct_io(fdOut, 1) != 0))
+			DPRINTF("%s: Direct I/O is not supported by the filesystem, using page cache\n", __FUNCTION__);
+
+		ret = process_fd_stream(ctx, fd, fdOut, 0, 1, NULL);
+
+		DPRINTF("%s: Encryption using direct I/O done with code %d\n", __FUNCTION__, ret);
+		return ret;
+	}
+
+#ifndef WINDOWS
+	ret = fd_positional(fd, fdOut) ? process_fd_io_mode(ctx, fd, fdOut, 0, NULL) : -ENOTSUP;
+	if (ret != -ENOTSUP) {
+		DPRINTF("%s: Encryption using I/O mode %d done with code %d\n", __FUNCTION__, ctx->io_mode, ret);
+		return ret;
+	}
+	ret = 0;
+
+	if (ctx->threads > 1) {
+		ret = mincrypt_parallel_process_fd(ctx, fd, fdOut, 0, ctx->threads, NULL);
+		if ((ret != -EAGAIN) && (ret != -ENOTSUP)) {
+			DPRINTF("%s: Encryption using %d threads done with code %d\n", __FUNCTION__, ctx->threads, ret);
+			return ret;
+		}
+
+		DPRINTF("%s: Cannot use %d threads (code %d), falling back\n", __FUNCTION__, ctx->threads, ret);
+		ret = 0;
+	}
+
+	/* Overlap reading and writing with the encryption, read and encrypt in turn if threads are not available */
+	if ((ret = mincrypt_pipeline_process_fd(ctx, fd, fdOut, 0, NULL)) != -EAGAIN) {
+		DPRINTF("%s: Encryption using pipeline done with code %d\n", __FUNCTION__, ret);
+		return ret;
+	}
+	ret = 0;
+#endif
+
+	outsize = mincrypt_ctx_get_encrypted_size(ctx, ctx->chunk_size);
+	if (((buf = (unsigned char *)malloc( ctx->chunk_size * sizeof(unsigned char) )) == NULL)
+		|| ((outbuf = (unsigned char *)malloc( outsize * sizeof(unsigned char) )) == NULL)) {
+		free(buf);
+		return -ENOMEM;
+	}
+	STATS_ADD(ctx, allocations, 2);
+
+	id = 1;
+	ctx->checksum = 0;
+	memset(&idx, 0, sizeof(idx));
+	while (1) {
+		size_t rct = 0;
+
+		t = STATS_START(ctx);
+		rc = read(fd, buf, ctx->chunk_size);
+		STATS_STOP(ctx, ns_io, t);
+		if (rc <= 0)
+			break;
+
+		if (((ret = mincrypt_ctx_encrypt_into(ctx, buf, (size_t)rc, id++, outbuf, outsize, &rct)) != 0)
+			|| ((ret = write_full(ctx, fdOut, outbuf, rct)) != 0))
+			break;
+
+		/* Chunk header holds CRC-32 of the plain chunk without the final inversion */
+		ctx->checksum = crc32_combine(ctx->checksum, CHUNK_PLAIN_CRC(outbuf), rc);
+
+		if (ctx->index && ((ret = chunk_index_add(&idx, rct, rc, id - 1)) != 0))
+			break;
+	}
+
+	if (rc < 0) {
+		errno_saved = errno;
+		chunk_index_free(&idx);
+		free(buf);
+		free(outbuf);
+		return -errno_saved;
+	}
+
+	if ((ret == 0) && ctx->index)
+		ret = chunk_index_write(&idx, fdOut);
+	chunk_index_free(&idx);
+	free(buf);
+	free(outbuf);
+
+	DPRINTF("%s: Encryption done with code %d\n", __FUNCTION__, ret);
+	return ret;
+}
+
+/*
+	Function name:		mincrypt_ctx_encrypt_file
+	Since version:		0.0.5
+	Description:		Function for the entire file encryption using the context. Takes the input and output files, salt, password and vector_multiplier value
+	Arguments:		@ctx [context]: context to be used for the encryption
+				@filename1 [string]: input (original) file
 				@filename2 [string]: output (encrypted) file
 				@salt [string]: salt value to be used, may be NULL to use already set IVs if applicable, used only with conjuction password
 				@password [string]: password value to be used, may be NULL to use already set IVs if applicable, used only with conjuction salt
 				@vector_multiplier [int]: vector multiplier value, can be 0, used only if salt and password are set
 	Returns:		0 for no error, otherwise error code
 */
-DLLEXPORT int mincrypt_encrypt_file(char *filename1, char *filename2, char *salt, char *password, int vector_multiplier)
+DLLEXPORT int mincrypt_ctx_encrypt_file(mincrypt_ctx_t *ctx, char *filename1, char *filename2, char *salt, char *password, int vector_multiplier)
 {
-	unsigned char buf[BUFFER_SIZE] = { 0 };
-	unsigned char *outbuf;
-	int fd, fdOut, rc, id, ret = 0, errno_saved;
+	int fd, fdOut, ret, errno_saved;
 
 	if ((salt != NULL) && (password != NULL))
-		mincrypt_set_password(salt, password, vector_multiplier);
+		mincrypt_ctx_set_password(ctx, salt, password, vector_multiplier);
 
 	DPRINTF("%s: Encrypting %s to %s\n", __FUNCTION__, filename1, filename2);
 	fd = open(filename1, O_RDONLY
@@ -1177,7 +2252,8 @@ DLLEXPORT int mincrypt_encrypt_file(char *filename1, char *filename2, char *salt
 		return -errno_saved;
 	}
 
-	fdOut = open(filename2, O_WRONLY | O_TRUNC | O_CREAT
+	/* Output has to be readable to be mapped */
+	fdOut = open(filename2, ((ctx->io_mode == IO_MODE_MMAP_RW) ? O_RDWR : O_WRONLY) | O_TRUNC | O_CREAT
 		#ifdef USE_LARGE_FILE
 		 | O_LARGEFILE
 		#endif
@@ -1188,48 +2264,110 @@ DLLEXPORT int mincrypt_encrypt_file(char *filename1, char *filename2, char *salt
 	if (fdOut < 0) {
 		errno_saved = errno;
 		DPRINTF("%s: Cannot open file %s for writing (code %d, %s)\n", __FUNCTION__, filename2, -errno, strerror(errno));
+		close(fd);
 		return -errno_saved;
 	}
 
-	id = 1;
-	while ((rc = read(fd, buf, sizeof(buf))) > 0) {
-		size_t rct = (size_t)rc;
-		outbuf = mincrypt_encrypt(buf, rct, id++, &rct);
-		rc = (int)rct;
-		write(fdOut, outbuf, rc);
-		free(outbuf);
-	}
-
-	if (rc < 0)
-		return -errno;
-
+	ret = mincrypt_ctx_encrypt_fd(ctx, fd, fdOut);
 	close(fd);
 	close(fdOut);
 
-	DPRINTF("%s: Encryption done with code %d\n", __FUNCTION__, ret);
 	return ret;
 }
 
 /*
-	Function name:		mincrypt_decrypt_file
+	Function name:		mincrypt_encrypt_file
 	Since version:		0.0.1
-	Description:		Function for the entire file decryption. Takes the input and output files, salt, password and vector_multiplier value
-	Arguments:		@filename1 [string]: input (encrypted) file
+	Description:		Function for the entire file encryption. Takes the input and output files, salt, password and vector_multiplier value
+	Arguments:		@filename1 [string]: input (original) file
+				@filename2 [string]: output (encrypted) file
+				@salt [string]: salt value to be used, may be NULL to use already set IVs if applicable, used only with conjuction password
+				@password [string]: password value to be used, may be NULL to use already set IVs if applicable, used only with conjuction salt
+				@vector_multiplier [int]: vector multiplier value, can be 0, used only if salt and password are set
+	Returns:		0 for no error, otherwise error code
+*/
+DLLEXPORT int mincrypt_encrypt_file(char *filename1, char *filename2, char *salt, char *password, int vector_multiplier)
+{
+	return mincrypt_ctx_encrypt_file(&default_ctx, filename1, filename2, salt, password, vector_multiplier);
+}
+
+/*
+	Function name:		mincrypt_ctx_decrypt_fd
+	Since version:		0.0.5
+	Description:		Function for the decryption of all the data read from the input file descriptor into the output file descriptor using the context. Any descriptors are supported including pipes and sockets, the I/O mode is used only if both of them are seekable files. The IVs have to be set already and the descriptors are not closed
+	Arguments:		@ctx [context]: context to be used for the decryption
+				@fd [int]: input (encrypted) file descriptor
+				@fdOut [int]: output (decrypted) file descriptor
+	Returns:		0 for no error, -EINVAL if no data has been decrypted, otherwise error code
+*/
+DLLEXPORT int mincrypt_ctx_decrypt_fd(mincrypt_ctx_t *ctx, int fd, int fdOut)
+{
+	uint64_t total = 0;
+	int ret = 0;
+
+#ifndef WINDOWS
+	/* Direct I/O needs aligned transfers which are done by the stream only */
+	if (!ctx->direct && ((ctx->io_mode != IO_MODE_READ) || (ctx->threads > 1))) {
+		ret = -ESPIPE;
+		if (fd_positional(fd, fdOut))
+			ret = process_fd_io_mode(ctx, fd, fdOut, 1, &total);
+
+		/* Decrypt chunks found by header scan, fall back to the pipeline for non-seekable files */
+		if ((ret == -ENOTSUP) && (ctx->threads > 1))
+			ret = mincrypt_parallel_decrypt_fd(ctx, fd, fdOut, ctx->threads, &total);
+		if ((ret == -ESPIPE) && (ctx->threads > 1))
+			ret = mincrypt_parallel_process_fd(ctx, fd, fdOut, 1, ctx->threads, &total);
+
+		/* Threads cannot be created, no input has been read so fall back to serial decryption */
+		if ((ret != -ENOTSUP) && (ret != -ESPIPE) && (ret != -EAGAIN))
+			goto out;
+		ret = 0;
+	}
+
+	/* Overlap reading and writing with the decryption, use the stream if threads are not available */
+	ret = -EAGAIN;
+	if (!ctx->direct)
+		ret = mincrypt_pipeline_process_fd(ctx, fd, fdOut, 1, &total);
+	if (ret == -EAGAIN)
+#endif
+	{
+		if (ctx->direct && ((set_direct_io(fd, 1) != 0) || (set_direct_io(fdOut, 1) != 0)))
+			DPRINTF("%s: Direct I/O is not supported by the filesystem, using page cache\n", __FUNCTION__);
+
+		ret = process_fd_stream(ctx, fd, fdOut, 1, ctx->direct, &total);
+	}
+
+#ifndef WINDOWS
+out:
+#endif
+	if ((ret == 0) && (total == 0))
+		ret = -EINVAL;
+
+	if (ret != 0)
+		DPRINTF("An error occured while decrypting input. Please check your salt/password and/or key if any used.\n");
+
+	DPRINTF("%s: Decryption done with code %d\n", __FUNCTION__, ret);
+	return ret;
+}
+
+/*
+	Function name:		mincrypt_ctx_decrypt_file
+	Since version:		0.0.5
+	Description:		Function for the entire file decryption using the context. Takes the input and output files, salt, password and vector_multiplier value
+	Arguments:		@ctx [context]: context to be used for the decryption
+				@filename1 [string]: input (encrypted) file
 				@filename2 [string]: output (decrypted) file
 				@salt [string]: salt value to be used, may be NULL to use already set IVs if applicable, used only with conjuction password
 				@password [string]: password value to be used, may be NULL to use already set IVs if applicable, used only with conjuction salt
 				@vector_multiplier [int]: vector multiplier value, can be 0, used only if salt and password are set
 	Returns:		0 for no error, otherwise error code
 */
-DLLEXPORT int mincrypt_decrypt_file(char *filename1, char *filename2, char *salt, char *password, int vector_multiplier)
+DLLEXPORT int mincrypt_ctx_decrypt_file(mincrypt_ctx_t *ctx, char *filename1, char *filename2, char *salt, char *password, int vector_multiplier)
 {
-	unsigned char buf[BUFFER_SIZE_BASE64+17+3 /* strlen(SIGNATURE) */] = { 0 };
-	char *outbuf;
-	int fd, fdOut, rc, rsize, id, ret = 0, to_read = BUFFER_SIZE_BASE64 + 17 + strlen(SIGNATURE);
-	uint64_t already_read = 0, total = 0;
+	int fd, fdOut, ret;
 
 	if ((salt != NULL) && (password != NULL))
-		mincrypt_set_password(salt, password, vector_multiplier);
+		mincrypt_ctx_set_password(ctx, salt, password, vector_multiplier);
 
 	DPRINTF("%s: Decrypting %s to %s\n", __FUNCTION__, filename1, filename2);
 	fd = open(filename1, O_RDONLY
@@ -1244,7 +2382,8 @@ DLLEXPORT int mincrypt_decrypt_file(char *filename1, char *filename2, char *salt
 		DPRINTF("%s: Cannot open file %s\n", __FUNCTION__, filename1);
 		return -EPERM;
 	}
-	fdOut = open(filename2, O_WRONLY | O_TRUNC | O_CREAT
+	/* Output has to be readable to be mapped */
+	fdOut = open(filename2, ((ctx->io_mode == IO_MODE_MMAP_RW) ? O_RDWR : O_WRONLY) | O_TRUNC | O_CREAT
 		#ifdef USE_LARGE_FILE
 		 | O_LARGEFILE
 		#endif
@@ -1254,54 +2393,59 @@ DLLEXPORT int mincrypt_decrypt_file(char *filename1, char *filename2, char *salt
 		, 0644);
 	if (fdOut < 0) {
 		DPRINTF("%s: Cannot open file %s for writing\n", __FUNCTION__, filename2);
+		close(fd);
 		return -EPERM;
 	}
 
-	id = 1;
-	while ((rc = read(fd, buf, to_read)) > 0) {
-		size_t rct = (size_t)rc;
-		outbuf = mincrypt_decrypt(buf, rct, id++, &rct, &rsize);
-		rc = (int)rct;
-		already_read += rsize + 17 + strlen(SIGNATURE);
-		if (simple_mode && (to_read != rsize + 17 + strlen(SIGNATURE))) {
-			to_read = rsize + 17 + strlen(SIGNATURE);
-			DPRINTF("%s: Current position is 0x%"PRIx64"\n", __FUNCTION__, already_read);
-			if (lseek(fd, already_read, SEEK_SET) != already_read)
-				DPRINTF("Warning: Seek error!\n");
-		}
-		else
-		if (!simple_mode) {
-			if (lseek(fd, already_read, SEEK_SET) != already_read)
-				DPRINTF("Warning: Seek error!\n");
-		}
-
-		if (rc == -1) {
-			DPRINTF("An error occured while decrypting input. Please check your salt/password and/or key if any used.\n");
-			free(outbuf);
-			close(fdOut);
-			fdOut = -1;
-			ret = -EINVAL;
-			unlink(filename2);
-			break;
-		}
+	ret = mincrypt_ctx_decrypt_fd(ctx, fd, fdOut);
+	close(fd);
+	close(fdOut);
 
-		write(fdOut, outbuf, rc);
-		free(outbuf);
+	if (ret != 0)
+		unlink(filename2);
 
-		total += rc;
-	}
+	return ret;
+}
 
-	if (fd != -1)
-		close(fd);
-	if (fdOut != -1)
-		close(fdOut);
+/*
+	Function name:		mincrypt_decrypt_file
+	Since version:		0.0.1
+	Description:		Function for the entire file decryption. Takes the input and output files, salt, password and vector_multiplier value
+	Arguments:		@filename1 [string]: input (encrypted) file
+				@filename2 [string]: output (decrypted) file
+				@salt [string]: salt value to be used, may be NULL to use already set IVs if applicable, used only with conjuction password
+				@password [string]: password value to be used, may be NULL to use already set IVs if applicable, used only with conjuction salt
+				@vector_multiplier [int]: vector multiplier value, can be 0, used only if salt and password are set
+	Returns:		0 for no error, otherwise error code
+*/
+DLLEXPORT int mincrypt_decrypt_file(char *filename1, char *filename2, char *salt, char *password, int vector_multiplier)
+{
+	return mincrypt_ctx_decrypt_file(&default_ctx, filename1, filename2, salt, password, vector_multiplier);
+}
 
-	if (total == 0) {
-		ret = -EINVAL;
-		unlink(filename2);
-	}
+/*
+	Function name:		mincrypt_encrypt_fd
+	Since version:		0.0.5
+	Description:		Function for the encryption of all the data read from the input file descriptor into the output file descriptor, e.g. pipes or sockets. The IVs have to be set already and the descriptors are not closed
+	Arguments:		@fd [int]: input (original) file descriptor
+				@fdOut [int]: output (encrypted) file descriptor
+	Returns:		0 for no error, otherwise error code
+*/
+DLLEXPORT int mincrypt_encrypt_fd(int fd, int fdOut)
+{
+	return mincrypt_ctx_encrypt_fd(&default_ctx, fd, fdOut);
+}
 
-	DPRINTF("%s: Decryption done with code %d\n", __FUNCTION__, ret);
-	return ret;
+/*
+	Function name:		mincrypt_decrypt_fd
+	Since version:		0.0.5
+	Description:		Function for the decryption of all the data read from the input file descriptor into the output file descriptor, e.g. pipes or sockets. The IVs have to be set already and the descriptors are not closed
+	Arguments:		@fd [int]: input (encrypted) file descriptor
+				@fdOut [int]: output (decrypted) file descriptor
+	Returns:		0 for no error, -EINVAL if no data has been decrypted, otherwise error code
+*/
+DLLEXPORT int mincrypt_decrypt_fd(int fd, int fdOut)
+{
+	return mincrypt_ctx_decrypt_fd(&default_ctx, fd, fdOut);
 }
 
@@ -16,8 +16,16 @@
 
 #define BUFFER_SIZE			(1 << 17)			/* Make 128 kB to be default buffer size */
 #define BUFFER_SIZE_BASE64		(((BUFFER_SIZE + 2) / 3) * 4)
+#define CHUNK_SIZE_AUTO			0				/* pick the chunk size by benchmark */
+#define CHUNK_SIZE_MIN			(1 << 12)
+#define CHUNK_SIZE_MAX			(1 << 24)
 #define O_LARGEFILE			0x0200000
 #define SIGNATURE			"MCF"
+#define INDEX_SIGNATURE			"MCI"
+#define INDEX_VERSION			0x01
+#define INDEX_HEADER_SIZE		(strlen(INDEX_SIGNATURE) + 5)
+#define INDEX_ENTRY_SIZE		24
+#define INDEX_TRAILER_SIZE		(strlen(INDEX_SIGNATURE) + 9)
 #define DEFAULT_SALT_VAL		SIGNATURE
 #define DEFAULT_VECTOR_MULT		0x20
 
@@ -25,6 +33,11 @@
 #define ENCODING_TYPE_BINARY		ENCODING_TYPE_BASE
 #define ENCODING_TYPE_BASE64		ENCODING_TYPE_BASE + 1
 
+#define IO_MODE_READ			0x00				/* read() and write() */
+#define IO_MODE_MMAP			0x01				/* mapped input, pwrite() output */
+#define IO_MODE_MMAP_RW			0x02				/* mapped input and output */
+#define IO_MODE_URING			0x03				/* asynchronous reads and writes using io_uring */
+
 //#define USE_LARGE_FILE
 
 #ifdef HAVE_CONFIG_H
@@ -35,6 +48,16 @@
 #undef O_LARGEFILE
 #define	O_LARGEFILE			0
 #define	strtok_r(s,d,p)			strtok(s,d)
+#undef rand_r
+#define	rand_r(s)			mincrypt_rand_r(s)
+#define	pread(fd,b,n,o)			((lseek(fd,o,SEEK_SET) < 0) ? -1 : read(fd,b,n))
+
+/* Reentrant generator advancing the caller's seed (the LCG of the C standard) */
+static inline int mincrypt_rand_r(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (int)((*seed / 65536) % 32768);
+}
 #endif
 
 #include <stdio.h>
@@ -86,10 +109,18 @@ void free_tokens(tTokenizer t);
 #define GETBYTE(var)    (var[0])
 #define GETWORD(var)    ((var[0] << 8) + (var[1]))
 #define GETUINT32(var)	(uint32_t)(((uint32_t)var[0] << 24) + ((uint32_t)var[1] << 16) + ((uint32_t)var[2] << 8) + ((uint32_t)var[3]))
+/* Final CRC-32 value of the plain data of the encrypted chunk, header stores it without the final inversion */
+#define CHUNK_PLAIN_CRC(chunk)	(GETUINT32(((chunk) + strlen(SIGNATURE) + 9)) ^ 0xFFFFFFFF)
 #define GETUINT64(var)	(uint64_t)(((uint64_t)var[0] << 56) + ((uint64_t)var[1] << 48) + ((uint64_t)var[2] << 40) + \
 			((uint64_t)var[3] << 32) + ((uint64_t)var[4] << 24) + ((uint64_t)var[5] << 16)  + \
 			((uint64_t)var[6] << 8) + (uint64_t)var[7])
 
+/* Statistics are updated atomically as the context may be shared by the worker threads */
+#define STATS_ADD(ctx, member, value)	\
+do { if ((ctx)->collect_stats) __atomic_fetch_add(&(ctx)->stats.member, (uint64_t)(value), __ATOMIC_RELAXED); } while (0)
+#define STATS_START(ctx)		(((ctx)->collect_stats) ? mincrypt_stats_clock() : 0)
+#define STATS_STOP(ctx, member, start)	STATS_ADD(ctx, member, mincrypt_stats_clock() - (start))
+
 typedef struct tPrimes {
 	int num;
 	uint64_t start;
@@ -110,6 +141,129 @@ typedef struct tPrimes {
 #define	APPROACH_SYMMETRIC	0x00
 #define	APPROACH_ASYMMETRIC	0x01
 
+#define	CIPHER_KERNEL_AUTO	0x00
+#define	CIPHER_KERNEL_SCALAR	0x01
+#define	CIPHER_KERNEL_SSE2	0x02
+#define	CIPHER_KERNEL_AVX2	0x03
+
+#define	CIPHER_MODE_SYMMETRIC_ENCRYPT	0x00
+#define	CIPHER_MODE_SYMMETRIC_DECRYPT	0x01
+#define	CIPHER_MODE_ASYMMETRIC_ENCRYPT	0x02
+#define	CIPHER_MODE_ASYMMETRIC_DECRYPT	0x03
+
+#define	BASE64_KERNEL_AUTO	0x00
+#define	BASE64_KERNEL_SCALAR	0x01
+#define	BASE64_KERNEL_AVX2	0x02
+
+#define	CRC32_IMPL_AUTO		0x00
+#define	CRC32_IMPL_BYTEWISE	0x01
+#define	CRC32_IMPL_SLICE8	0x02
+#define	CRC32_IMPL_SLICE16	0x03
+#define	CRC32_IMPL_PCLMUL	0x04
+
+#define	CIPHER_PERIOD_MAX	8192				/* Longest key stream period generated on stack */
+
+/* Runtime statistics of the context, collected only if enabled by mincrypt_ctx_set_stats() */
+typedef struct tMincryptStats {
+	uint64_t bytes_in;		/* bytes of the chunks passed to encryption or decryption */
+	uint64_t bytes_out;		/* bytes of the chunks produced by encryption or decryption */
+	uint64_t chunks;
+	uint64_t crc_failures;
+	uint64_t allocations;		/* data buffers allocated */
+	uint64_t ns_crc;		/* nanoseconds spent in CRC-32 calculation */
+	uint64_t ns_cipher;		/* nanoseconds spent in the key stream transformation */
+	uint64_t ns_base64;		/* nanoseconds spent in base64 encoding and decoding */
+	uint64_t ns_io;			/* nanoseconds spent reading and writing files */
+} mincrypt_stats_t;
+
+typedef struct tMincryptCtx {
+	uint32_t *iv;
+	uint32_t *ivn;			/* used for asymmetric approach */
+	uint32_t *iva;			/* used for asymmetric approach */
+	uint64_t ival;
+	int vector_size;
+	int avector_size;		/* used for asymmetric approach */
+	int type_approach;
+	int out_type;
+	int simple_mode;
+	int threads;
+	uint32_t checksum;		/* CRC-32 of the plain data of the last file processed */
+	int index;			/* append chunk index to encrypted files */
+	int io_mode;			/* IO_MODE_* used by file encryption and decryption */
+	int direct;			/* bypass the page cache using O_DIRECT */
+	size_t chunk_size;		/* size of the plain data of the encrypted chunks */
+	int collect_stats;		/* update stats, timing needs two clock readings per measured step */
+	mincrypt_stats_t stats;
+} mincrypt_ctx_t;
+
+/* Entry of the chunk index footer */
+typedef struct tChunkIndexEntry {
+	uint64_t offset;		/* offset of the chunk in the encrypted file */
+	uint64_t plain_offset;		/* offset of the chunk data in the plain file */
+	uint32_t size;
+	uint32_t id;
+} tChunkIndexEntry;
+
+typedef struct tChunkIndex {
+	tChunkIndexEntry *entries;
+	int num;
+	int allocated;
+	uint64_t offset;		/* offset of the next chunk, i.e. of the index once all chunks are added */
+	uint64_t plain_offset;
+} tChunkIndex;
+
+/* Callback receiving the output of a stream, returning non-zero aborts the stream */
+typedef int (*tMincryptStreamWrite)(void *opaque, unsigned char *data, size_t size);
+
+typedef struct tMincryptStream mincrypt_stream_t;
+
+typedef void (*tCipherKernel)(unsigned char *out, const unsigned char *ks, const unsigned char *in, size_t len);
+
+/* Key stream of the transformation for a single chunk */
+typedef struct tCipherKey {
+	mincrypt_ctx_t *ctx;
+	uint32_t shift;
+	unsigned char c0;
+	void (*fill)(struct tCipherKey *key, unsigned char *ks, int off, int len);
+	tCipherKernel kernel;
+	int period;			/* zero if key stream is generated on the fly */
+	unsigned char ks[2 * CIPHER_PERIOD_MAX];
+} cipher_key_t;
+
+/* Context functions */
+mincrypt_ctx_t *mincrypt_ctx_create(void);
+void mincrypt_ctx_free(mincrypt_ctx_t *ctx);
+void mincrypt_ctx_set_password(mincrypt_ctx_t *ctx, char *salt, char *password, int vector_multiplier);
+int mincrypt_ctx_set_encoding_type(mincrypt_ctx_t *ctx, int type);
+int mincrypt_ctx_set_simple_mode(mincrypt_ctx_t *ctx, int enable);
+int mincrypt_ctx_set_threads(mincrypt_ctx_t *ctx, int threads);
+int mincrypt_ctx_set_index(mincrypt_ctx_t *ctx, int enable);
+int mincrypt_ctx_set_io_mode(mincrypt_ctx_t *ctx, int mode);
+int mincrypt_ctx_set_direct(mincrypt_ctx_t *ctx, int enable);
+int mincrypt_ctx_set_chunk_size(mincrypt_ctx_t *ctx, size_t size);
+size_t mincrypt_ctx_get_chunk_size(mincrypt_ctx_t *ctx);
+int mincrypt_ctx_set_stats(mincrypt_ctx_t *ctx, int enable);
+int mincrypt_ctx_get_stats(mincrypt_ctx_t *ctx, mincrypt_stats_t *stats);
+uint32_t mincrypt_ctx_get_checksum(mincrypt_ctx_t *ctx);
+int mincrypt_ctx_read_key_file(mincrypt_ctx_t *ctx, char *keyfile, int *oIsPrivate);
+void mincrypt_ctx_dump_vectors(mincrypt_ctx_t *ctx, char *dump_file);
+void mincrypt_ctx_cleanup(mincrypt_ctx_t *ctx);
+unsigned char *mincrypt_ctx_encrypt(mincrypt_ctx_t *ctx, unsigned char *block, size_t size, int id, size_t *new_size);
+unsigned char *mincrypt_ctx_decrypt(mincrypt_ctx_t *ctx, unsigned char *block, size_t size, int id, size_t *new_size, int *read_size);
+size_t mincrypt_ctx_get_encrypted_size(mincrypt_ctx_t *ctx, size_t size);
+int mincrypt_ctx_encrypt_into(mincrypt_ctx_t *ctx, unsigned char *block, size_t size, int id, unsigned char *out, size_t out_size, size_t *new_size);
+int mincrypt_ctx_decrypt_into(mincrypt_ctx_t *ctx, unsigned char *block, size_t size, int id, unsigned char *out, size_t out_size, size_t *new_size, int *read_size);
+int mincrypt_ctx_encrypt_file(mincrypt_ctx_t *ctx, char *filename1, char *filename2, char *salt, char *password, int vector_multiplier);
+int mincrypt_ctx_decrypt_file(mincrypt_ctx_t *ctx, char *filename1, char *filename2, char *salt, char *password, int vector_multiplier);
+int mincrypt_ctx_encrypt_fd(mincrypt_ctx_t *ctx, int fd, int fdOut);
+int mincrypt_ctx_decrypt_fd(mincrypt_ctx_t *ctx, int fd, int fdOut);
+ssize_t mincrypt_ctx_pread(mincrypt_ctx_t *ctx, int fd, unsigned char *buf, size_t len, uint64_t offset);
+mincrypt_stream_t *mincrypt_ctx_stream_init(mincrypt_ctx_t *ctx, int decrypt, tMincryptStreamWrite write, void *opaque);
+
+/* Stream functions */
+int mincrypt_stream_update(mincrypt_stream_t *stream, unsigned char *data, size_t size);
+int mincrypt_stream_final(mincrypt_stream_t *stream);
+
 /* Public functions */
 void mincrypt_set_password(char *salt, char *password, int vector_multiplier);
 int mincrypt_set_encoding_type(int type);
@@ -118,16 +272,63 @@ int mincrypt_read_key_file(char *keyfile, int *oIsPrivate);
 void mincrypt_cleanup(void);
 unsigned char *mincrypt_encrypt(unsigned char *block, size_t size, int id, size_t *new_size);
 unsigned char *mincrypt_decrypt(unsigned char *block, size_t size, int id, size_t *new_size, int *read_size);
+size_t mincrypt_get_encrypted_size(size_t size);
+size_t mincrypt_get_decrypted_size(unsigned char *block, size_t size);
+int mincrypt_encrypt_into(unsigned char *block, size_t size, int id, unsigned char *out, size_t out_size, size_t *new_size);
+int mincrypt_decrypt_into(unsigned char *block, size_t size, int id, unsigned char *out, size_t out_size, size_t *new_size, int *read_size);
 int mincrypt_encrypt_file(char *filename1, char *filename2, char *salt, char *password, int vector_multiplier);
 int mincrypt_decrypt_file(char *filename1, char *filename2, char *salt, char *password, int vector_multiplier);
+int mincrypt_encrypt_fd(int fd, int fdOut);
+int mincrypt_decrypt_fd(int fd, int fdOut);
 int mincrypt_generate_keys(int bits, char *salt, char *password, char *key_private, char *key_public);
 long mincrypt_get_version(void);
 int mincrypt_set_simple_mode(int enable);
+int mincrypt_set_threads(int threads);
+int mincrypt_set_index(int enable);
+int mincrypt_set_io_mode(int mode);
+int mincrypt_set_direct(int enable);
+int mincrypt_set_chunk_size(size_t size);
+size_t mincrypt_get_chunk_size(void);
+int mincrypt_set_stats(int enable);
+int mincrypt_get_stats(mincrypt_stats_t *stats);
+ssize_t mincrypt_pread(int fd, unsigned char *buf, size_t len, uint64_t offset);
+uint32_t mincrypt_get_checksum(void);
+mincrypt_stream_t *mincrypt_stream_init(int decrypt, tMincryptStreamWrite write, void *opaque);
 
 /* Function prototypes */
+uint64_t mincrypt_stats_clock(void);
+int mincrypt_parallel_process_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, int threads, uint64_t *total);
+int mincrypt_parallel_decrypt_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int threads, uint64_t *total);
+int mincrypt_pipeline_process_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, uint64_t *total);
+int mincrypt_mmap_process_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, int threads, uint64_t *total);
+int mincrypt_uring_process_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, uint64_t *total);
+int cipher_set_kernel(int kernel);
+int cipher_get_kernel(void);
+void cipher_key_init(cipher_key_t *key, mincrypt_ctx_t *ctx, int size, uint32_t crc, int id, int mode, unsigned char shiftByte);
+void cipher_key_apply(cipher_key_t *key, unsigned char *out, const unsigned char *in, int off, int len);
+ssize_t chunk_parse_header(const unsigned char *hdr, uint32_t *orig_size);
+int chunk_check_span(const unsigned char *chunk, uint64_t chunk_size, uint64_t size);
+int chunk_index_add(tChunkIndex *idx, size_t chunk_size, size_t plain_size, int id);
+int chunk_index_plan(mincrypt_ctx_t *ctx, tChunkIndex *idx, uint64_t size);
+unsigned char *chunk_index_serialize(tChunkIndex *idx, size_t *size);
+int chunk_index_write(tChunkIndex *idx, int fd);
+int chunk_index_scan(int fd, tChunkIndex *idx);
+int pread_full(int fd, unsigned char *buf, size_t size, uint64_t offset);
+int pwrite_full(int fd, unsigned char *buf, size_t size, uint64_t offset);
+void chunk_index_free(tChunkIndex *idx);
+void crc32_gentab(void);
+int crc32_set_impl(int impl);
+int crc32_get_impl(void);
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+uint32_t crc32_file(char *filename, int chunkSize);
+int crc32_file_parallel(char *filename, int threads, uint32_t *crc);
 uint32_t crc32_block(unsigned char *block, uint32_t length, uint64_t initVal);
 unsigned char *base64_encode(const char *in, size_t *size);
 unsigned char *base64_decode(const char *in, size_t *size);
+size_t base64_encoded_size(size_t len);
+int base64_set_kernel(int kernel);
+size_t base64_encode_buffer(unsigned char *out, const unsigned char *in, size_t len);
+int base64_decode_buffer(unsigned char *out, const unsigned char *in, size_t len);
 char *dec_to_hex(int dec);
 uint64_t bits_to_num(char *bits, int num);
 char *num_to_bits(uint64_t code, int *out_bits);
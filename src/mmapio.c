@@ -0,0 +1,304 @@
+/*
+ *  mmapio.c: Memory-mapped file encryption and decryption
+ *
+ *  Copyright (c) 2010-2011, Michal Novotny <mignov@gmail.com>
+ *  All rights reserved.
+ *
+ *  See COPYING for the license of this software
+ *
+ */
+
+#include "mincrypt.h"
+
+#ifndef WINDOWS
+#include <pthread.h>
+#include <sys/mman.h>
+
+#ifndef DISABLE_DEBUG
+#define DEBUG_MMAPIO
+#endif
+
+#ifdef DEBUG_MMAPIO
+#define DPRINTF(fmt, ...) \
+do { fprintf(stderr, "[mincrypt/mmapio      ] " fmt , ## __VA_ARGS__); } while (0)
+#else
+#define DPRINTF(fmt, ...) \
+do {} while(0)
+#endif
+
+#ifndef MAP_POPULATE
+#define	MAP_POPULATE		0
+#endif
+
+/* Range of chunks processed by a single thread */
+typedef struct tMmapJob {
+	mincrypt_ctx_t *ctx;
+	int decrypt;
+	unsigned char *in;
+	unsigned char *out;		/* mapped output or NULL to write output using pwrite() */
+	int fdOut;
+	size_t bufsize;			/* size of the output buffer used if output is not mapped */
+	tChunkIndex *idx;
+	uint32_t *crcs;
+	int first;
+	int last;
+	int error;
+} tMmapJob;
+
+/*
+	Private function name:	mmap_job_run
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the range of chunks of the job. The chunks are read directly from the mapped input and written directly to the mapped output if available
+	Arguments:		@opaque [job]: job to run
+	Returns:		NULL, job->error is set on error
+*/
+static void *mmap_job_run(void *opaque)
+{
+	tMmapJob *job = (tMmapJob *)opaque;
+	tChunkIndexEntry *e;
+	unsigned char *buf = NULL, *dst;
+	uint64_t chunk_size, t;
+	size_t size = 0;
+	int i, rc = 0;
+
+	if (job->out == NULL) {
+		if ((buf = (unsigned char *)malloc( job->bufsize * sizeof(unsigned char) )) == NULL) {
+			job->error = -ENOMEM;
+			return NULL;
+		}
+		STATS_ADD(job->ctx, allocations, 1);
+	}
+
+	for (i = job->first; (rc == 0) && (i < job->last); i++) {
+		e = &job->idx->entries[i];
+		chunk_size = ((i + 1 < job->idx->num) ? e[1].offset : job->idx->offset) - e->offset;
+
+		if (job->decrypt) {
+			dst = (job->out != NULL) ? job->out + e->plain_offset : buf;
+			rc = mincrypt_ctx_decrypt_into(job->ctx, job->in + e->offset, chunk_size, e->id, dst, e->size, &size, NULL);
+			if (rc == 0) {
+				job->crcs[i] = CHUNK_PLAIN_CRC((job->in + e->offset));
+				if (job->out == NULL) {
+					t = STATS_START(job->ctx);
+					rc = pwrite_full(job->fdOut, dst, size, e->plain_offset);
+					STATS_STOP(job->ctx, ns_io, t);
+				}
+			}
+		}
+		else {
+			dst = (job->out != NULL) ? job->out + e->offset : buf;
+			rc = mincrypt_ctx_encrypt_into(job->ctx, job->in + e->plain_offset, e->size, e->id, dst, chunk_size, &size);
+			if (rc == 0) {
+				job->crcs[i] = CHUNK_PLAIN_CRC(dst);
+				if (job->out == NULL) {
+					t = STATS_START(job->ctx);
+					rc = pwrite_full(job->fdOut, dst, size, e->offset);
+					STATS_STOP(job->ctx, ns_io, t);
+				}
+			}
+		}
+	}
+
+	if (rc != 0)
+		DPRINTF("%s: Processing of chunk #%d failed with code %d\n", __FUNCTION__, i, rc);
+
+	free(buf);
+	job->error = rc;
+	return NULL;
+}
+
+/*
+	Private function name:	mmap_walk_chunks
+	Since version:		0.0.5
+	Description:		This function is used to get the layout of the chunks of the mapped encrypted file
+	Arguments:		@data [buffer]: mapped encrypted file
+				@size [size_t]: size of the file
+				@idx [index]: output value for the chunk layout
+	Returns:		0 on success, -EINVAL for invalid or truncated file, -ENOMEM if cannot allocate memory
+*/
+static int mmap_walk_chunks(unsigned char *data, size_t size, tChunkIndex *idx)
+{
+	uint32_t orig_size;
+	ssize_t csize;
+	int ret = 0;
+
+	memset(idx, 0, sizeof(tChunkIndex));
+	while ((ret == 0) && (idx->offset < size)) {
+		if (size - idx->offset < strlen(SIGNATURE) + 17) {
+			/* Chunk index may be shorter than the chunk header only if it has no entries */
+			if ((size - idx->offset < strlen(INDEX_SIGNATURE))
+				|| (memcmp(data + idx->offset, INDEX_SIGNATURE, strlen(INDEX_SIGNATURE)) != 0))
+				ret = -EINVAL;
+			break;
+		}
+
+		if ((csize = chunk_parse_header(data + idx->offset, &orig_size)) <= 0) {
+			ret = csize;
+			break;
+		}
+
+		if (csize > size - idx->offset)
+			ret = -EINVAL;
+		else
+			ret = chunk_index_add(idx, csize, orig_size, idx->num + 1);
+	}
+
+	if (ret != 0)
+		chunk_index_free(idx);
+
+	return ret;
+}
+
+/*
+	Function name:		mincrypt_mmap_process_fd
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the whole input file mapped to memory. Chunks are processed directly from the mapping, the output is either mapped too (IO_MODE_MMAP_RW) or written by a single pwrite() per chunk (IO_MODE_MMAP). As the positions of all the chunks are known in advance the chunks are split between the threads evenly
+	Arguments:		@ctx [context]: context to be used for the processing
+				@fd [int]: input file descriptor
+				@fdOut [int]: output file descriptor, mapped for IO_MODE_MMAP_RW only if open for reading too
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+				@threads [int]: number of threads
+				@total [uint64_t]: output variable for the number of bytes of plain data, may be NULL
+	Returns:		0 for no error, -ENOTSUP if the files cannot be mapped and read or write mode has to be used, -errno otherwise
+*/
+int mincrypt_mmap_process_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, int threads, uint64_t *total)
+{
+	unsigned char *in = MAP_FAILED, *out = MAP_FAILED, *index = NULL;
+	size_t in_size, out_size, index_size = 0, bufsize = 0;
+	pthread_t *workers = NULL;
+	tMmapJob *jobs = NULL;
+	uint32_t *crcs = NULL;
+	tChunkIndex idx;
+	struct stat st;
+	int i, num_workers, ret = 0;
+
+	memset(&idx, 0, sizeof(idx));
+
+	if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size == 0)
+		|| ((uint64_t)st.st_size > (size_t)-1) || (lseek(fdOut, 0, SEEK_CUR) < 0))
+		return -ENOTSUP;
+
+	in_size = st.st_size;
+	in = (unsigned char *)mmap(NULL, in_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	if (in == MAP_FAILED) {
+		DPRINTF("%s: Cannot map input file (%s)\n", __FUNCTION__, strerror(errno));
+		return -ENOTSUP;
+	}
+	madvise(in, in_size, MADV_SEQUENTIAL);
+
+	/* Layout of the output is given by the header size formula for encryption and by the chunk headers for decryption */
+	if (decrypt) {
+		if ((ret = mmap_walk_chunks(in, in_size, &idx)) != 0)
+			goto cleanup;
+		out_size = idx.plain_offset;
+
+		for (i = 0; i < idx.num; i++)
+			if (idx.entries[i].size > bufsize)
+				bufsize = idx.entries[i].size;
+	}
+	else {
+		ret = chunk_index_plan(ctx, &idx, in_size);
+		if ((ret == 0) && ctx->index && ((index = chunk_index_serialize(&idx, &index_size)) == NULL))
+			ret = -ENOMEM;
+		if (ret != 0)
+			goto cleanup;
+		out_size = idx.offset + index_size;
+		bufsize = mincrypt_ctx_get_encrypted_size(ctx, ctx->chunk_size);
+	}
+
+	if ((idx.num == 0) || ((crcs = (uint32_t *)malloc( idx.num * sizeof(uint32_t) )) == NULL)) {
+		ret = (idx.num == 0) ? -EINVAL : -ENOMEM;
+		goto cleanup;
+	}
+
+	/* Descriptors of the caller may be open for writing only, pwrite() is used for them */
+	if ((ctx->io_mode == IO_MODE_MMAP_RW) && ((fcntl(fdOut, F_GETFL) & O_ACCMODE) == O_RDWR)) {
+		if ((posix_fallocate(fdOut, 0, out_size) != 0) && (ftruncate(fdOut, out_size) != 0)) {
+			ret = -errno;
+			goto cleanup;
+		}
+
+		out = (unsigned char *)mmap(NULL, out_size, PROT_READ | PROT_WRITE, MAP_SHARED, fdOut, 0);
+		if (out == MAP_FAILED) {
+			ret = -errno;
+			DPRINTF("%s: Cannot map output file (%s)\n", __FUNCTION__, strerror(-ret));
+			goto cleanup;
+		}
+	}
+
+	if (threads > idx.num)
+		threads = idx.num;
+	if (threads < 1)
+		threads = 1;
+
+	jobs = (tMmapJob *)malloc( threads * sizeof(tMmapJob) );
+	workers = (pthread_t *)malloc( threads * sizeof(pthread_t) );
+	if ((jobs == NULL) || (workers == NULL)) {
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+
+	crc32_gentab();
+
+	DPRINTF("%s: %s %d chunks using %d threads\n", __FUNCTION__, decrypt ? "Decrypting" : "Encrypting", idx.num, threads);
+
+	for (i = 0; i < threads; i++) {
+		jobs[i].ctx = ctx;
+		jobs[i].decrypt = decrypt;
+		jobs[i].in = in;
+		jobs[i].out = (out != MAP_FAILED) ? out : NULL;
+		jobs[i].fdOut = fdOut;
+		jobs[i].bufsize = bufsize;
+		jobs[i].idx = &idx;
+		jobs[i].crcs = crcs;
+		jobs[i].first = (int)(((uint64_t)idx.num * i) / threads);
+		jobs[i].last = (int)(((uint64_t)idx.num * (i + 1)) / threads);
+		jobs[i].error = 0;
+	}
+
+	/* The calling thread runs the first job and the jobs no thread could be started for */
+	for (num_workers = 1; num_workers < threads; num_workers++)
+		if (pthread_create(&workers[num_workers], NULL, mmap_job_run, &jobs[num_workers]) != 0)
+			break;
+
+	mmap_job_run(&jobs[0]);
+	for (i = num_workers; i < threads; i++)
+		mmap_job_run(&jobs[i]);
+
+	for (i = 1; i < num_workers; i++)
+		pthread_join(workers[i], NULL);
+
+	for (i = 0; (ret == 0) && (i < threads); i++)
+		ret = jobs[i].error;
+
+	if ((ret == 0) && (index != NULL)) {
+		if (out != MAP_FAILED)
+			memcpy(out + idx.offset, index, index_size);
+		else
+			ret = pwrite_full(fdOut, index, index_size, idx.offset);
+	}
+
+	if (ret == 0) {
+		ctx->checksum = 0;
+		for (i = 0; i < idx.num; i++)
+			ctx->checksum = crc32_combine(ctx->checksum, crcs[i], idx.entries[i].size);
+
+		if (total != NULL)
+			*total = idx.plain_offset;
+	}
+
+	DPRINTF("%s: Processing done with code %d\n", __FUNCTION__, ret);
+
+cleanup:
+	if (out != MAP_FAILED)
+		munmap(out, out_size);
+	munmap(in, in_size);
+	free(index);
+	free(crcs);
+	free(jobs);
+	free(workers);
+	chunk_index_free(&idx);
+
+	return ret;
+}
+#endif
@@ -0,0 +1,912 @@
+/*
+ *  parallel.c: Multithreaded chunk processing for file encryption and decryption
+ *
+ *  Copyright (c) 2010-2011, Michal Novotny <mignov@gmail.com>
+ *  All rights reserved.
+ *
+ *  See COPYING for the license of this software
+ *
+ */
+
+#include "mincrypt.h"
+
+#ifndef WINDOWS
+#include <pthread.h>
+#include <sched.h>
+
+#ifndef DISABLE_DEBUG
+#define DEBUG_PARALLEL
+#endif
+
+#ifdef DEBUG_PARALLEL
+#define DPRINTF(fmt, ...) \
+do { fprintf(stderr, "[mincrypt/parallel    ] " fmt , ## __VA_ARGS__); } while (0)
+#else
+#define DPRINTF(fmt, ...) \
+do {} while(0)
+#endif
+
+#define	SLOT_EMPTY		0x00
+#define	SLOT_READY		0x01
+#define	SLOT_DONE		0x02
+
+typedef struct tSlot {
+	int state;
+	int id;
+	unsigned char *in;
+	size_t in_size;
+	size_t in_alloc;
+	unsigned char *out;
+	size_t out_size;
+	size_t out_alloc;
+} tSlot;
+
+typedef struct tPool {
+	mincrypt_ctx_t *ctx;
+	int decrypt;
+	int fdOut;
+	int window;
+	tSlot *slots;
+	/* Number of chunks read, taken by workers and written */
+	int num_read;
+	int num_taken;
+	int num_written;
+	int eof;
+	int error;
+	uint64_t total;
+	uint32_t checksum;
+	tChunkIndex index;
+	pthread_mutex_t lock;
+	pthread_cond_t cond_work;
+	pthread_cond_t cond_done;
+	pthread_cond_t cond_free;
+} tPool;
+
+/* Decryption of the chunks found by the header scan, each worker writes its chunks to their final position */
+typedef struct tScanPool {
+	mincrypt_ctx_t *ctx;
+	int fd;
+	int fdOut;
+	tChunkIndex *idx;
+	uint32_t *crcs;
+	size_t in_bufsize;
+	size_t out_bufsize;
+	int next;
+	int error;
+	pthread_mutex_t lock;
+} tScanPool;
+
+/* Number of slots of the pipeline, every queue can hold all of them */
+#define	PIPELINE_SLOTS		4
+#define	PIPELINE_SPINS		64
+
+/* Lock-free queue with single producer and single consumer */
+typedef struct tSpscQueue {
+	tSlot *slots[PIPELINE_SLOTS];
+	unsigned head;			/* changed by the consumer only */
+	unsigned tail;			/* changed by the producer only */
+} tSpscQueue;
+
+/* Three stage pipeline, the slots go from free to full to done queue and back */
+typedef struct tPipeline {
+	mincrypt_ctx_t *ctx;
+	int decrypt;
+	int fd;
+	int fdOut;
+	int error;
+	uint64_t total;
+	tSlot slots[PIPELINE_SLOTS];
+	tSpscQueue free;
+	tSpscQueue full;
+	tSpscQueue done;
+} tPipeline;
+
+/*
+	Private function name:	read_full
+	Since version:		0.0.5
+	Description:		This function is used to read exactly size bytes unless the end of file is reached
+	Arguments:		@ctx [context]: context to account the time spent reading to
+				@fd [int]: file descriptor to read from
+				@buf [buffer]: buffer to read data to
+				@size [size_t]: number of bytes to read
+	Returns:		number of bytes read, -errno on error
+*/
+static ssize_t read_full(mincrypt_ctx_t *ctx, int fd, unsigned char *buf, size_t size)
+{
+	uint64_t t = STATS_START(ctx);
+	size_t done = 0;
+	ssize_t rc;
+
+	while (done < size) {
+		rc = read(fd, buf + done, size - done);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (rc == 0)
+			break;
+
+		done += rc;
+	}
+
+	STATS_STOP(ctx, ns_io, t);
+	return done;
+}
+
+/*
+	Private function name:	write_full
+	Since version:		0.0.5
+	Description:		This function is used to write the whole buffer handling the short writes
+	Arguments:		@ctx [context]: context to account the time spent writing to
+				@fd [int]: file descriptor to write to
+				@buf [buffer]: buffer to be written
+				@size [size_t]: number of bytes to write
+	Returns:		0 on success, -errno on error
+*/
+static int write_full(mincrypt_ctx_t *ctx, int fd, unsigned char *buf, size_t size)
+{
+	uint64_t t = STATS_START(ctx);
+	ssize_t rc;
+
+	while (size > 0) {
+		rc = write(fd, buf, size);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		buf += rc;
+		size -= rc;
+	}
+
+	STATS_STOP(ctx, ns_io, t);
+	return 0;
+}
+
+/*
+	Function name:		pwrite_full
+	Since version:		0.0.5
+	Description:		This function is used to write the whole buffer to the offset of the file handling the short writes
+	Arguments:		@fd [int]: file descriptor to write to
+				@buf [buffer]: buffer to be written
+				@size [size_t]: number of bytes to write
+				@offset [uint64_t]: offset in the file
+	Returns:		0 on success, -errno on error
+*/
+int pwrite_full(int fd, unsigned char *buf, size_t size, uint64_t offset)
+{
+	ssize_t rc;
+
+	while (size > 0) {
+		rc = pwrite(fd, buf, size, offset);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		buf += rc;
+		size -= rc;
+		offset += rc;
+	}
+
+	return 0;
+}
+
+static void pool_set_error(tPool *pool, int error)
+{
+	pthread_mutex_lock(&pool->lock);
+	if (pool->error == 0)
+		pool->error = error;
+	pthread_cond_broadcast(&pool->cond_work);
+	pthread_cond_broadcast(&pool->cond_done);
+	pthread_cond_broadcast(&pool->cond_free);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void *worker_thread(void *opaque)
+{
+	tPool *pool = (tPool *)opaque;
+	tSlot *slot;
+	size_t size = 0;
+	int rc;
+
+	while (1) {
+		pthread_mutex_lock(&pool->lock);
+		while ((pool->num_taken == pool->num_read) && !pool->eof && !pool->error)
+			pthread_cond_wait(&pool->cond_work, &pool->lock);
+
+		if (pool->error || (pool->num_taken == pool->num_read)) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		slot = &pool->slots[pool->num_taken++ % pool->window];
+		pthread_mutex_unlock(&pool->lock);
+
+		if (pool->decrypt)
+			rc = mincrypt_ctx_decrypt_into(pool->ctx, slot->in, slot->in_size, slot->id,
+					slot->out, slot->out_alloc, &size, NULL);
+		else
+			rc = mincrypt_ctx_encrypt_into(pool->ctx, slot->in, slot->in_size, slot->id,
+					slot->out, slot->out_alloc, &size);
+
+		if (rc != 0) {
+			DPRINTF("%s: Processing of chunk #%d failed with code %d\n", __FUNCTION__, slot->id, rc);
+			pool_set_error(pool, rc);
+			break;
+		}
+		slot->out_size = size;
+
+		pthread_mutex_lock(&pool->lock);
+		slot->state = SLOT_DONE;
+		pthread_cond_broadcast(&pool->cond_done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+static void *writer_thread(void *opaque)
+{
+	tPool *pool = (tPool *)opaque;
+	tSlot *slot;
+	int rc;
+
+	while (1) {
+		pthread_mutex_lock(&pool->lock);
+		slot = &pool->slots[pool->num_written % pool->window];
+		while ((slot->state != SLOT_DONE) && !pool->error
+			&& !(pool->eof && (pool->num_written == pool->num_read)))
+			pthread_cond_wait(&pool->cond_done, &pool->lock);
+
+		if (slot->state != SLOT_DONE) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		/* Chunks are written in the order they have been read */
+		rc = write_full(pool->ctx, pool->fdOut, slot->out, slot->out_size);
+
+		if (rc < 0) {
+			DPRINTF("%s: Cannot write chunk #%d (%s)\n", __FUNCTION__, slot->id, strerror(-rc));
+			pool_set_error(pool, -EIO);
+			break;
+		}
+
+		/* Merge CRC-32 of the plain chunk stored in the chunk header */
+		if (pool->decrypt)
+			pool->checksum = crc32_combine(pool->checksum, CHUNK_PLAIN_CRC(slot->in), slot->out_size);
+		else
+			pool->checksum = crc32_combine(pool->checksum, CHUNK_PLAIN_CRC(slot->out), slot->in_size);
+
+		if (!pool->decrypt && pool->ctx->index
+			&& (chunk_index_add(&pool->index, slot->out_size, slot->in_size, slot->id) != 0)) {
+			pool_set_error(pool, -ENOMEM);
+			break;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		slot->state = SLOT_EMPTY;
+		pool->total += slot->out_size;
+		pool->num_written++;
+		pthread_cond_broadcast(&pool->cond_free);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+/*
+	Private function name:	slot_reserve
+	Since version:		0.0.5
+	Description:		This function is used to make sure the slot buffer is big enough to hold size bytes, the data already in the buffer are kept
+	Arguments:		@ctx [context]: context to account the allocation to
+				@buf [buffer]: pointer to the buffer
+				@alloc [size_t]: pointer to the allocated size of the buffer
+				@size [size_t]: number of bytes required
+	Returns:		0 on success, -ENOMEM if the buffer cannot be allocated
+*/
+static int slot_reserve(mincrypt_ctx_t *ctx, unsigned char **buf, size_t *alloc, size_t size)
+{
+	unsigned char *tmp;
+
+	if (*alloc >= size)
+		return 0;
+
+	if ((tmp = (unsigned char *)realloc(*buf, size)) == NULL)
+		return -ENOMEM;
+
+	STATS_ADD(ctx, allocations, 1);
+	*buf = tmp;
+	*alloc = size;
+	return 0;
+}
+
+/*
+	Private function name:	read_chunk
+	Since version:		0.0.5
+	Description:		This function is used to read the next chunk to the slot. For encryption it reads the chunk size of the context, for decryption it reads exactly one encrypted chunk as described by its header. The slot buffers are enlarged for chunks bigger than expected as the file may have been encrypted using different chunk size
+	Arguments:		@ctx [context]: context used for the processing
+				@decrypt [int]: boolean whether the chunk is read for encryption or decryption (0 = encrypt, 1 = decrypt)
+				@fd [int]: input file descriptor
+				@slot [slot]: slot to read the chunk to
+	Returns:		number of bytes read, 0 on end of file, -errno on error
+*/
+static ssize_t read_chunk(mincrypt_ctx_t *ctx, int decrypt, int fd, tSlot *slot)
+{
+	int hdrlen = strlen(SIGNATURE) + 17;
+	uint32_t orig_size;
+	ssize_t rc, csize;
+	int ret;
+
+	if (!decrypt)
+		return read_full(ctx, fd, slot->in, ctx->chunk_size);
+
+	rc = read_full(ctx, fd, slot->in, hdrlen);
+	if (rc <= 0)
+		return rc;
+
+	/* Chunk index follows the last chunk */
+	if ((rc >= strlen(INDEX_SIGNATURE)) && (memcmp(slot->in, INDEX_SIGNATURE, strlen(INDEX_SIGNATURE)) == 0))
+		return 0;
+
+	if ((rc != hdrlen) || ((csize = chunk_parse_header(slot->in, &orig_size)) <= 0)) {
+		DPRINTF("%s: Invalid chunk header found\n", __FUNCTION__);
+		return -EINVAL;
+	}
+
+	if (orig_size == 0) {
+		DPRINTF("%s: Invalid chunk size of %"PRIu32" bytes\n", __FUNCTION__, orig_size);
+		return -EINVAL;
+	}
+
+	if (((ret = slot_reserve(ctx, &slot->in, &slot->in_alloc, csize)) != 0)
+		|| ((ret = slot_reserve(ctx, &slot->out, &slot->out_alloc, orig_size)) != 0))
+		return ret;
+
+	rc = read_full(ctx, fd, slot->in + hdrlen, csize - hdrlen);
+	if (rc < 0)
+		return rc;
+	if (rc != csize - hdrlen)
+		return -EINVAL;
+
+	return csize;
+}
+
+/*
+	Private function name:	mincrypt_parallel_process_fd
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the whole input using the pool of worker threads. Chunks are read by the calling thread, processed by the workers and written by the writer thread in their original order. The number of chunks in flight is bounded by twice the number of workers
+	Arguments:		@ctx [context]: context to be used for the processing
+				@fd [int]: input file descriptor
+				@fdOut [int]: output file descriptor
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+				@threads [int]: number of worker threads
+				@total [uint64_t]: output variable for the number of bytes written, may be NULL
+	Returns:		0 for no error, -EAGAIN if the threads cannot be created (no input has been read then), -errno otherwise
+*/
+int mincrypt_parallel_process_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, int threads, uint64_t *total)
+{
+	pthread_t *workers = NULL;
+	pthread_t writer;
+	tPool pool;
+	tSlot *slot;
+	size_t in_bufsize, out_bufsize;
+	ssize_t rc;
+	int i, id, num_workers = 0, ret = 0;
+
+	memset(&pool, 0, sizeof(pool));
+	pool.ctx = ctx;
+	pool.decrypt = decrypt;
+	pool.fdOut = fdOut;
+	pool.window = 2 * threads;
+
+	/* Buffers for decryption are enlarged by read_chunk() if the file uses bigger chunks */
+	in_bufsize = decrypt ? mincrypt_ctx_get_encrypted_size(ctx, ctx->chunk_size) : ctx->chunk_size;
+	out_bufsize = decrypt ? ctx->chunk_size : mincrypt_ctx_get_encrypted_size(ctx, ctx->chunk_size);
+
+	pool.slots = (tSlot *)malloc( pool.window * sizeof(tSlot) );
+	workers = (pthread_t *)malloc( threads * sizeof(pthread_t) );
+	if ((pool.slots == NULL) || (workers == NULL)) {
+		free(pool.slots);
+		free(workers);
+		return -ENOMEM;
+	}
+	memset(pool.slots, 0, pool.window * sizeof(tSlot));
+
+	for (i = 0; i < pool.window; i++) {
+		if ((slot_reserve(ctx, &pool.slots[i].in, &pool.slots[i].in_alloc, in_bufsize) != 0)
+			|| (slot_reserve(ctx, &pool.slots[i].out, &pool.slots[i].out_alloc, out_bufsize) != 0)) {
+			ret = -ENOMEM;
+			goto cleanup;
+		}
+	}
+
+	/* Make sure the shared CRC table is ready before workers use it */
+	crc32_gentab();
+
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond_work, NULL);
+	pthread_cond_init(&pool.cond_done, NULL);
+	pthread_cond_init(&pool.cond_free, NULL);
+
+	DPRINTF("%s: Starting %d workers with %d slots\n", __FUNCTION__, threads, pool.window);
+
+	if (pthread_create(&writer, NULL, writer_thread, &pool) != 0) {
+		ret = -EAGAIN;
+		goto destroy;
+	}
+
+	for (num_workers = 0; num_workers < threads; num_workers++)
+		if (pthread_create(&workers[num_workers], NULL, worker_thread, &pool) != 0)
+			break;
+
+	if (num_workers == 0)
+		pool_set_error(&pool, -EAGAIN);
+
+	id = 1;
+	while (1) {
+		pthread_mutex_lock(&pool.lock);
+		slot = &pool.slots[pool.num_read % pool.window];
+		while ((slot->state != SLOT_EMPTY) && !pool.error)
+			pthread_cond_wait(&pool.cond_free, &pool.lock);
+		i = pool.error;
+		pthread_mutex_unlock(&pool.lock);
+
+		if (i != 0)
+			break;
+
+		rc = read_chunk(ctx, decrypt, fd, slot);
+		if (rc <= 0) {
+			if (rc < 0)
+				pool_set_error(&pool, (int)rc);
+			break;
+		}
+
+		slot->in_size = rc;
+		slot->id = id++;
+
+		pthread_mutex_lock(&pool.lock);
+		slot->state = SLOT_READY;
+		pool.num_read++;
+		pthread_cond_signal(&pool.cond_work);
+		pthread_mutex_unlock(&pool.lock);
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.eof = 1;
+	pthread_cond_broadcast(&pool.cond_work);
+	pthread_cond_broadcast(&pool.cond_done);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (i = 0; i < num_workers; i++)
+		pthread_join(workers[i], NULL);
+	pthread_join(writer, NULL);
+
+	ret = pool.error;
+	if ((ret == 0) && (pool.num_read == 0) && decrypt)
+		ret = -EINVAL;
+
+	if ((ret == 0) && !decrypt && ctx->index)
+		ret = chunk_index_write(&pool.index, fdOut);
+
+	DPRINTF("%s: Processed %d chunks with code %d\n", __FUNCTION__, pool.num_written, ret);
+
+destroy:
+	pthread_cond_destroy(&pool.cond_free);
+	pthread_cond_destroy(&pool.cond_done);
+	pthread_cond_destroy(&pool.cond_work);
+	pthread_mutex_destroy(&pool.lock);
+cleanup:
+	for (i = 0; i < pool.window; i++) {
+		free(pool.slots[i].in);
+		free(pool.slots[i].out);
+	}
+	free(pool.slots);
+	free(workers);
+	chunk_index_free(&pool.index);
+
+	if (total != NULL)
+		*total = pool.total;
+	ctx->checksum = pool.checksum;
+
+	return ret;
+}
+
+/*
+	Private function name:	spsc_push
+	Since version:		0.0.5
+	Description:		This function is used to append the slot to the single-producer single-consumer queue. The queue is never full as it can hold all the slots of the pipeline
+	Arguments:		@q [queue]: queue to append the slot to
+				@slot [slot]: slot to be appended
+	Returns:		None
+*/
+static void spsc_push(tSpscQueue *q, tSlot *slot)
+{
+	unsigned tail = q->tail;
+
+	q->slots[tail % PIPELINE_SLOTS] = slot;
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+	Private function name:	spsc_pop
+	Since version:		0.0.5
+	Description:		This function is used to take the first slot of the single-producer single-consumer queue, waiting for it if the queue is empty. Waiting spins for a while and then sleeps for short intervals as there is no lock to wait on
+	Arguments:		@q [queue]: queue to take the slot from
+				@error [int]: pointer to the error of the pipeline, waiting stops once it's set
+	Returns:		slot or NULL if the queue is empty and an error occurred
+*/
+static tSlot *spsc_pop(tSpscQueue *q, int *error)
+{
+	unsigned head = q->head;
+	struct timespec ts = { 0, 50000 };
+	tSlot *slot;
+	int spins = 0;
+
+	while (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head) {
+		if (__atomic_load_n(error, __ATOMIC_ACQUIRE) != 0)
+			return NULL;
+
+		if (spins++ < PIPELINE_SPINS)
+			sched_yield();
+		else
+			nanosleep(&ts, NULL);
+	}
+
+	slot = q->slots[head % PIPELINE_SLOTS];
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+	return slot;
+}
+
+/*
+	Private function name:	pipeline_set_error
+	Since version:		0.0.5
+	Description:		This function is used to set the error of the pipeline, only the first error is kept
+	Arguments:		@pipe [pipeline]: pipeline to set the error for
+				@error [int]: error code
+	Returns:		None
+*/
+static void pipeline_set_error(tPipeline *pipe, int error)
+{
+	int expected = 0;
+
+	__atomic_compare_exchange_n(&pipe->error, &expected, error, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/*
+	Private function name:	pipeline_reader_thread
+	Since version:		0.0.5
+	Description:		This function is used as the first stage of the pipeline reading chunks to the free slots. Empty slot is passed on at the end of file
+	Arguments:		@opaque [pipeline]: pipeline to read the chunks for
+	Returns:		NULL
+*/
+static void *pipeline_reader_thread(void *opaque)
+{
+	tPipeline *pipe = (tPipeline *)opaque;
+	tSlot *slot;
+	ssize_t rc;
+
+	while ((slot = spsc_pop(&pipe->free, &pipe->error)) != NULL) {
+		if ((rc = read_chunk(pipe->ctx, pipe->decrypt, pipe->fd, slot)) < 0) {
+			DPRINTF("%s: Cannot read chunk (%s)\n", __FUNCTION__, strerror(-rc));
+			pipeline_set_error(pipe, (int)rc);
+			break;
+		}
+
+		slot->in_size = rc;
+		spsc_push(&pipe->full, slot);
+		if (rc == 0)
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+	Private function name:	pipeline_writer_thread
+	Since version:		0.0.5
+	Description:		This function is used as the last stage of the pipeline writing the processed chunks and returning their slots to the reader
+	Arguments:		@opaque [pipeline]: pipeline to write the chunks for
+	Returns:		NULL
+*/
+static void *pipeline_writer_thread(void *opaque)
+{
+	tPipeline *pipe = (tPipeline *)opaque;
+	tSlot *slot;
+	int rc;
+
+	while (((slot = spsc_pop(&pipe->done, &pipe->error)) != NULL) && (slot->in_size > 0)) {
+		if ((rc = write_full(pipe->ctx, pipe->fdOut, slot->out, slot->out_size)) != 0) {
+			DPRINTF("%s: Cannot write chunk #%d (%s)\n", __FUNCTION__, slot->id, strerror(-rc));
+			pipeline_set_error(pipe, rc);
+			break;
+		}
+
+		spsc_push(&pipe->free, slot);
+	}
+
+	return NULL;
+}
+
+/*
+	Function name:		mincrypt_pipeline_process_fd
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the whole input using three stage pipeline. The reader thread reads the next chunks ahead, the calling thread transforms them and the writer thread writes the previous ones, so I/O overlaps with computation even with two CPUs. Stages are connected by lock-free single-producer single-consumer queues of PIPELINE_SLOTS preallocated slots
+	Arguments:		@ctx [context]: context to be used for the processing
+				@fd [int]: input file descriptor, doesn't have to be seekable
+				@fdOut [int]: output file descriptor, doesn't have to be seekable
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+				@total [uint64_t]: output variable for the number of bytes written, may be NULL
+	Returns:		0 for no error, -EAGAIN if the threads cannot be created, -errno otherwise
+*/
+int mincrypt_pipeline_process_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, uint64_t *total)
+{
+	pthread_t reader, writer;
+	tChunkIndex idx;
+	tPipeline pipe;
+	tSlot *slot;
+	size_t size = 0;
+	int i, id, rc, ret = 0;
+
+	memset(&pipe, 0, sizeof(pipe));
+	memset(&idx, 0, sizeof(idx));
+	pipe.ctx = ctx;
+	pipe.decrypt = decrypt;
+	pipe.fd = fd;
+	pipe.fdOut = fdOut;
+
+	for (i = 0; i < PIPELINE_SLOTS; i++) {
+		/* Buffers for decryption are enlarged by read_chunk() if the file uses bigger chunks */
+		if ((slot_reserve(ctx, &pipe.slots[i].in, &pipe.slots[i].in_alloc,
+				decrypt ? mincrypt_ctx_get_encrypted_size(ctx, ctx->chunk_size) : ctx->chunk_size) != 0)
+			|| (slot_reserve(ctx, &pipe.slots[i].out, &pipe.slots[i].out_alloc,
+				decrypt ? ctx->chunk_size : mincrypt_ctx_get_encrypted_size(ctx, ctx->chunk_size)) != 0)) {
+			ret = -ENOMEM;
+			goto cleanup;
+		}
+
+		spsc_push(&pipe.free, &pipe.slots[i]);
+	}
+
+	crc32_gentab();
+
+	if (pthread_create(&reader, NULL, pipeline_reader_thread, &pipe) != 0) {
+		ret = -EAGAIN;
+		goto cleanup;
+	}
+
+	if (pthread_create(&writer, NULL, pipeline_writer_thread, &pipe) != 0) {
+		pipeline_set_error(&pipe, -EAGAIN);
+		pthread_join(reader, NULL);
+		ret = -EAGAIN;
+		goto cleanup;
+	}
+
+	ctx->checksum = 0;
+	id = 1;
+	while ((slot = spsc_pop(&pipe.full, &pipe.error)) != NULL) {
+		if (slot->in_size == 0) {
+			spsc_push(&pipe.done, slot);
+			break;
+		}
+
+		slot->id = id++;
+		if (decrypt)
+			rc = mincrypt_ctx_decrypt_into(ctx, slot->in, slot->in_size, slot->id, slot->out, slot->out_alloc, &size, NULL);
+		else
+			rc = mincrypt_ctx_encrypt_into(ctx, slot->in, slot->in_size, slot->id, slot->out, slot->out_alloc, &size);
+
+		if (rc != 0) {
+			DPRINTF("%s: Processing of chunk #%d failed with code %d\n", __FUNCTION__, slot->id, rc);
+			pipeline_set_error(&pipe, rc);
+			break;
+		}
+		slot->out_size = size;
+
+		/* Merge CRC-32 of the plain chunk stored in the chunk header */
+		if (decrypt)
+			ctx->checksum = crc32_combine(ctx->checksum, CHUNK_PLAIN_CRC(slot->in), slot->out_size);
+		else
+			ctx->checksum = crc32_combine(ctx->checksum, CHUNK_PLAIN_CRC(slot->out), slot->in_size);
+
+		if (!decrypt && ctx->index && ((rc = chunk_index_add(&idx, slot->out_size, slot->in_size, slot->id)) != 0)) {
+			pipeline_set_error(&pipe, rc);
+			break;
+		}
+
+		pipe.total += slot->out_size;
+		spsc_push(&pipe.done, slot);
+	}
+
+	pthread_join(reader, NULL);
+	pthread_join(writer, NULL);
+
+	ret = pipe.error;
+	if ((ret == 0) && (id == 1) && decrypt)
+		ret = -EINVAL;
+
+	if ((ret == 0) && !decrypt && ctx->index)
+		ret = chunk_index_write(&idx, fdOut);
+
+	DPRINTF("%s: Processed %d chunks with code %d\n", __FUNCTION__, id - 1, ret);
+
+cleanup:
+	for (i = 0; i < PIPELINE_SLOTS; i++) {
+		free(pipe.slots[i].in);
+		free(pipe.slots[i].out);
+	}
+	chunk_index_free(&idx);
+
+	if (total != NULL)
+		*total = pipe.total;
+
+	return ret;
+}
+
+/*
+	Private function name:	scan_worker_thread
+	Since version:		0.0.5
+	Description:		This function is used as the worker thread of decryption by header scan. Each worker takes the next chunk of the index, reads it using pread(), checks it against the index entry, decrypts it and writes it to its place in the output using pwrite()
+	Arguments:		@opaque [pointer]: pointer to the scan pool
+	Returns:		NULL
+*/
+static void *scan_worker_thread(void *opaque)
+{
+	tScanPool *pool = (tScanPool *)opaque;
+	tChunkIndexEntry *e;
+	unsigned char *in, *out;
+	size_t size = 0;
+	uint64_t chunk_size, t;
+	int i, rc = 0;
+
+	in = (unsigned char *)malloc( pool->in_bufsize * sizeof(unsigned char) );
+	out = (unsigned char *)malloc( pool->out_bufsize * sizeof(unsigned char) );
+	if ((in == NULL) || (out == NULL))
+		rc = -ENOMEM;
+	else
+		STATS_ADD(pool->ctx, allocations, 2);
+
+	while (rc == 0) {
+		pthread_mutex_lock(&pool->lock);
+		if (pool->error || (pool->next == pool->idx->num)) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		e = &pool->idx->entries[i];
+		chunk_size = ((i + 1 < pool->idx->num) ? e[1].offset : pool->idx->offset) - e->offset;
+
+		t = STATS_START(pool->ctx);
+		if ((rc = pread_full(pool->fd, in, chunk_size, e->offset)) != 0)
+			break;
+		STATS_STOP(pool->ctx, ns_io, t);
+
+		/* Index may come from the footer so make sure it matches the chunk */
+		if ((rc = chunk_check_span(in, chunk_size, e->size)) != 0)
+			break;
+
+		if ((rc = mincrypt_ctx_decrypt_into(pool->ctx, in, chunk_size, e->id, out, pool->out_bufsize, &size, NULL)) != 0)
+			break;
+
+		if (size != e->size) {
+			rc = -EINVAL;
+			break;
+		}
+
+		pool->crcs[i] = CHUNK_PLAIN_CRC(in);
+		t = STATS_START(pool->ctx);
+		if ((rc = pwrite_full(pool->fdOut, out, size, e->plain_offset)) != 0)
+			break;
+		STATS_STOP(pool->ctx, ns_io, t);
+	}
+
+	if (rc != 0) {
+		DPRINTF("%s: Processing of chunk failed with code %d\n", __FUNCTION__, rc);
+		pthread_mutex_lock(&pool->lock);
+		if (pool->error == 0)
+			pool->error = rc;
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	free(in);
+	free(out);
+	return NULL;
+}
+
+/*
+	Private function name:	mincrypt_parallel_decrypt_fd
+	Since version:		0.0.5
+	Description:		This function is used to decrypt the whole seekable input using the pool of worker threads. The chunk layout is found by chunk_index_scan() first, then the workers read, decrypt and write the chunks independently using pread() and pwrite() so there is no single reader or writer to wait for
+	Arguments:		@ctx [context]: context to be used for the processing
+				@fd [int]: input file descriptor
+				@fdOut [int]: output file descriptor
+				@threads [int]: number of worker threads
+				@total [uint64_t]: output variable for the number of bytes written, may be NULL
+	Returns:		0 for no error, -ESPIPE if input or output is not seekable, -EAGAIN if the threads cannot be created (nothing has been written then), -errno otherwise
+*/
+int mincrypt_parallel_decrypt_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int threads, uint64_t *total)
+{
+	pthread_t *workers = NULL;
+	tScanPool pool;
+	tChunkIndex idx;
+	uint64_t chunk_size;
+	int i, num_workers = 0, ret;
+
+	if (lseek(fdOut, 0, SEEK_CUR) < 0)
+		return -ESPIPE;
+
+	if ((ret = chunk_index_scan(fd, &idx)) != 0)
+		return ret;
+
+	if (idx.num == 0) {
+		chunk_index_free(&idx);
+		return -EINVAL;
+	}
+
+	memset(&pool, 0, sizeof(pool));
+	pool.ctx = ctx;
+	pool.fd = fd;
+	pool.fdOut = fdOut;
+	pool.idx = &idx;
+
+	for (i = 0; i < idx.num; i++) {
+		chunk_size = ((i + 1 < idx.num) ? idx.entries[i + 1].offset : idx.offset) - idx.entries[i].offset;
+		if (chunk_size > pool.in_bufsize)
+			pool.in_bufsize = chunk_size;
+		if (idx.entries[i].size > pool.out_bufsize)
+			pool.out_bufsize = idx.entries[i].size;
+	}
+
+	if (threads > idx.num)
+		threads = idx.num;
+
+	pool.crcs = (uint32_t *)malloc( idx.num * sizeof(uint32_t) );
+	workers = (pthread_t *)malloc( threads * sizeof(pthread_t) );
+	if ((pool.crcs == NULL) || (workers == NULL)) {
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+
+	crc32_gentab();
+	pthread_mutex_init(&pool.lock, NULL);
+
+	DPRINTF("%s: Decrypting %d chunks using %d workers\n", __FUNCTION__, idx.num, threads);
+
+	for (num_workers = 0; num_workers < threads; num_workers++)
+		if (pthread_create(&workers[num_workers], NULL, scan_worker_thread, &pool) != 0)
+			break;
+
+	if (num_workers == 0)
+		pool.error = -EAGAIN;
+
+	for (i = 0; i < num_workers; i++)
+		pthread_join(workers[i], NULL);
+
+	pthread_mutex_destroy(&pool.lock);
+
+	ret = pool.error;
+	if (ret == 0) {
+		ctx->checksum = 0;
+		for (i = 0; i < idx.num; i++)
+			ctx->checksum = crc32_combine(ctx->checksum, pool.crcs[i], idx.entries[i].size);
+
+		if (total != NULL)
+			*total = idx.plain_offset;
+	}
+
+	DPRINTF("%s: Decryption of %d chunks done with code %d\n", __FUNCTION__, idx.num, ret);
+
+cleanup:
+	free(pool.crcs);
+	free(workers);
+	chunk_index_free(&idx);
+	return ret;
+}
+#endif
@@ -0,0 +1,380 @@
+/*
+ *  stream.c: Streaming encryption and decryption of arbitrary-length input
+ *
+ *  Copyright (c) 2010-2011, Michal Novotny <mignov@gmail.com>
+ *  All rights reserved.
+ *
+ *  See COPYING for the license of this software
+ *
+ */
+
+#include "mincrypt.h"
+
+#ifndef DISABLE_DEBUG
+#define DEBUG_STREAM
+#endif
+
+#ifdef WINDOWS
+	#ifdef BUILDING_DLL
+		#define DLLEXPORT __declspec(dllexport)
+	#else
+		#define DLLEXPORT __declspec(dllimport)
+	#endif
+#else
+	#define DLLEXPORT	
+#endif
+
+#ifdef DEBUG_STREAM
+#define DPRINTF(fmt, ...) \
+do { fprintf(stderr, "[mincrypt/stream      ] " fmt , ## __VA_ARGS__); } while (0)
+#else
+#define DPRINTF(fmt, ...) \
+do {} while(0)
+#endif
+
+#define	CHUNK_HEADER_SIZE	(strlen(SIGNATURE) + 17)
+
+struct tMincryptStream {
+	mincrypt_ctx_t *ctx;
+	int decrypt;
+	int id;
+	int error;
+	int eof;			/* chunk index found by decryption stream */
+	tMincryptStreamWrite write;
+	void *opaque;
+	/* Pending plain data for encryption or pending encrypted chunk for decryption */
+	unsigned char *buf;
+	size_t buf_size;
+	size_t buf_len;
+	/* Size of the chunk being collected for decryption, zero until its header is complete */
+	size_t chunk_size;
+	/* Size of the plain chunks for encryption, taken from the context when the stream is created */
+	size_t block_size;
+	unsigned char *out;
+	size_t out_size;
+	uint32_t checksum;
+	tChunkIndex index;
+};
+
+/*
+	Private function name:	stream_reserve
+	Since version:		0.0.5
+	Description:		This function is used to make sure the buffer is big enough to hold size bytes
+	Arguments:		@ctx [context]: context to account the allocation to
+				@buf [buffer]: pointer to the buffer, may point to NULL
+				@buf_size [size_t]: pointer to the allocated size of the buffer
+				@size [size_t]: number of bytes required
+	Returns:		0 on success, -ENOMEM if the buffer cannot be allocated
+*/
+static int stream_reserve(mincrypt_ctx_t *ctx, unsigned char **buf, size_t *buf_size, size_t size)
+{
+	unsigned char *tmp;
+
+	if (*buf_size >= size)
+		return 0;
+
+	if ((tmp = (unsigned char *)realloc(*buf, size)) == NULL) {
+		DPRINTF("%s: Cannot allocate %ld bytes of memory\n", __FUNCTION__, (unsigned long)size);
+		return -ENOMEM;
+	}
+
+	STATS_ADD(ctx, allocations, 1);
+	*buf = tmp;
+	*buf_size = size;
+	return 0;
+}
+
+/*
+	Private function name:	stream_chunk_size
+	Since version:		0.0.5
+	Description:		This function is used to get the size of the encrypted chunk including its header from the chunk header
+	Arguments:		@stream [stream]: stream the chunk belongs to
+				@hdr [buffer]: chunk header of CHUNK_HEADER_SIZE bytes
+	Returns:		size of the chunk in bytes, 0 if the chunk index starts here, -EINVAL for invalid header, -ENOMEM if output buffer cannot be allocated
+*/
+static ssize_t stream_chunk_size(mincrypt_stream_t *stream, unsigned char *hdr)
+{
+	uint32_t orig_size;
+	ssize_t csize;
+	int ret;
+
+	if ((csize = chunk_parse_header(hdr, &orig_size)) <= 0) {
+		if (csize < 0)
+			DPRINTF("%s: Invalid chunk header\n", __FUNCTION__);
+		return csize;
+	}
+
+	if ((ret = stream_reserve(stream->ctx, &stream->out, &stream->out_size, orig_size)) != 0)
+		return ret;
+
+	return csize;
+}
+
+/*
+	Private function name:	stream_process
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt a single chunk and pass the result to the write callback
+	Arguments:		@stream [stream]: stream to process the chunk for
+				@data [buffer]: plain data for encryption or the whole encrypted chunk for decryption
+				@size [size_t]: size of data
+	Returns:		0 on success, -errno on error
+*/
+static int stream_process(mincrypt_stream_t *stream, unsigned char *data, size_t size)
+{
+	size_t new_size = 0;
+	int ret;
+
+	if (!stream->decrypt && ((ret = stream_reserve(stream->ctx, &stream->out, &stream->out_size,
+				mincrypt_ctx_get_encrypted_size(stream->ctx, size))) != 0))
+		return ret;
+
+	if (stream->decrypt)
+		ret = mincrypt_ctx_decrypt_into(stream->ctx, data, size, stream->id, stream->out,
+				stream->out_size, &new_size, NULL);
+	else
+		ret = mincrypt_ctx_encrypt_into(stream->ctx, data, size, stream->id, stream->out,
+				stream->out_size, &new_size);
+
+	if (ret != 0) {
+		DPRINTF("%s: Processing of chunk #%d failed with code %d\n", __FUNCTION__, stream->id, ret);
+		return ret;
+	}
+
+	if (!stream->decrypt && stream->ctx->index
+		&& ((ret = chunk_index_add(&stream->index, new_size, size, stream->id)) != 0))
+		return ret;
+
+	stream->id++;
+	if (stream->decrypt)
+		stream->checksum = crc32_combine(stream->checksum, CHUNK_PLAIN_CRC(data), new_size);
+	else
+		stream->checksum = crc32_combine(stream->checksum, CHUNK_PLAIN_CRC(stream->out), size);
+
+	return stream->write(stream->opaque, stream->out, new_size);
+}
+
+/*
+	Private function name:	stream_update_encrypt
+	Since version:		0.0.5
+	Description:		This function is used to append plain data to the stream, full chunks are encrypted directly from the input when nothing is pending
+	Arguments:		@stream [stream]: stream to append data to
+				@data [buffer]: plain data
+				@size [size_t]: size of data
+	Returns:		0 on success, -errno on error
+*/
+static int stream_update_encrypt(mincrypt_stream_t *stream, unsigned char *data, size_t size)
+{
+	size_t len;
+	int ret;
+
+	while (size > 0) {
+		if ((stream->buf_len == 0) && (size >= stream->block_size)) {
+			if ((ret = stream_process(stream, data, stream->block_size)) != 0)
+				return ret;
+
+			data += stream->block_size;
+			size -= stream->block_size;
+			continue;
+		}
+
+		len = stream->block_size - stream->buf_len;
+		if (len > size)
+			len = size;
+
+		memcpy(stream->buf + stream->buf_len, data, len);
+		stream->buf_len += len;
+		data += len;
+		size -= len;
+
+		if (stream->buf_len == stream->block_size) {
+			stream->buf_len = 0;
+			if ((ret = stream_process(stream, stream->buf, stream->block_size)) != 0)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+/*
+	Private function name:	stream_update_decrypt
+	Since version:		0.0.5
+	Description:		This function is used to append encrypted data to the stream, chunks completely present in the input are decrypted without copying when nothing is pending
+	Arguments:		@stream [stream]: stream to append data to
+				@data [buffer]: encrypted data
+				@size [size_t]: size of data
+	Returns:		0 on success, -errno on error
+*/
+static int stream_update_decrypt(mincrypt_stream_t *stream, unsigned char *data, size_t size)
+{
+	ssize_t csize;
+	size_t len;
+	int ret;
+
+	while ((size > 0) && !stream->eof) {
+		if ((stream->buf_len == 0) && (size >= CHUNK_HEADER_SIZE)) {
+			if ((csize = stream_chunk_size(stream, data)) < 0)
+				return (int)csize;
+
+			/* Chunk index follows the last chunk, ignore it and anything after it */
+			if (csize == 0) {
+				stream->eof = 1;
+				break;
+			}
+
+			if (size >= csize) {
+				if ((ret = stream_process(stream, data, csize)) != 0)
+					return ret;
+
+				data += csize;
+				size -= csize;
+				continue;
+			}
+		}
+
+		/* Collect the header first to know the size of the whole chunk */
+		len = ((stream->chunk_size > 0) ? stream->chunk_size : CHUNK_HEADER_SIZE) - stream->buf_len;
+		if (len > size)
+			len = size;
+
+		memcpy(stream->buf + stream->buf_len, data, len);
+		stream->buf_len += len;
+		data += len;
+		size -= len;
+
+		if ((stream->chunk_size == 0) && (stream->buf_len == CHUNK_HEADER_SIZE)) {
+			if ((csize = stream_chunk_size(stream, stream->buf)) < 0)
+				return (int)csize;
+			if (csize == 0) {
+				stream->eof = 1;
+				stream->buf_len = 0;
+				break;
+			}
+			if ((ret = stream_reserve(stream->ctx, &stream->buf, &stream->buf_size, csize)) != 0)
+				return ret;
+
+			stream->chunk_size = csize;
+		}
+
+		if ((stream->chunk_size > 0) && (stream->buf_len == stream->chunk_size)) {
+			len = stream->chunk_size;
+			stream->buf_len = 0;
+			stream->chunk_size = 0;
+			if ((ret = stream_process(stream, stream->buf, len)) != 0)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+/*
+	Function name:		mincrypt_ctx_stream_init
+	Since version:		0.0.5
+	Description:		This function is used to create a stream for encryption or decryption of input of any length written in pieces of any size. Data are buffered internally and each complete chunk is passed to the write callback as soon as it's processed. Chunk identifiers are tracked by the stream so the output is the same as the output of mincrypt_ctx_encrypt_file() for the same input. The chunk size of the context is recorded when the stream is created, chunks of any size are accepted for decryption
+	Arguments:		@ctx [context]: context to be used, must be valid until mincrypt_stream_final() is called
+				@decrypt [int]: zero to encrypt, non-zero to decrypt
+				@write [callback]: function called with each block of the output, returning non-zero aborts the stream
+				@opaque [pointer]: value passed to the write callback
+	Returns:		new stream or NULL if cannot allocate memory
+*/
+DLLEXPORT mincrypt_stream_t *mincrypt_ctx_stream_init(mincrypt_ctx_t *ctx, int decrypt, tMincryptStreamWrite write, void *opaque)
+{
+	mincrypt_stream_t *stream;
+
+	if ((ctx == NULL) || (write == NULL))
+		return NULL;
+
+	if ((stream = (mincrypt_stream_t *)malloc(sizeof(mincrypt_stream_t))) == NULL)
+		return NULL;
+
+	memset(stream, 0, sizeof(mincrypt_stream_t));
+	stream->ctx = ctx;
+	stream->decrypt = decrypt;
+	stream->id = 1;
+	stream->write = write;
+	stream->opaque = opaque;
+	stream->block_size = ctx->chunk_size;
+
+	if (stream_reserve(stream->ctx, &stream->buf, &stream->buf_size, decrypt ? CHUNK_HEADER_SIZE : stream->block_size) != 0) {
+		free(stream);
+		return NULL;
+	}
+
+	DPRINTF("%s: Created %s stream\n", __FUNCTION__, decrypt ? "decryption" : "encryption");
+	return stream;
+}
+
+/*
+	Function name:		mincrypt_stream_update
+	Since version:		0.0.5
+	Description:		This function is used to write data to the stream. Plain data are written for encryption stream and encrypted chunks, possibly split at any position, for decryption stream
+	Arguments:		@stream [stream]: stream to write data to
+				@data [buffer]: data to be written
+				@size [size_t]: size of data
+	Returns:		0 on success, -errno on error. Once an error occurs all the subsequent calls fail with the same error
+*/
+DLLEXPORT int mincrypt_stream_update(mincrypt_stream_t *stream, unsigned char *data, size_t size)
+{
+	if (stream == NULL)
+		return -EINVAL;
+
+	if (stream->error != 0)
+		return stream->error;
+
+	if (stream->decrypt)
+		stream->error = stream_update_decrypt(stream, data, size);
+	else
+		stream->error = stream_update_encrypt(stream, data, size);
+
+	return stream->error;
+}
+
+/*
+	Function name:		mincrypt_stream_final
+	Since version:		0.0.5
+	Description:		This function is used to process the data pending in the stream and to free the stream. The CRC-32 checksum of all the plain data of the stream is available using mincrypt_ctx_get_checksum() afterwards
+	Arguments:		@stream [stream]: stream to be finished
+	Returns:		0 on success, -EINVAL if decryption stream ends in the middle of a chunk, -errno on other error
+*/
+DLLEXPORT int mincrypt_stream_final(mincrypt_stream_t *stream)
+{
+	int ret;
+
+	if (stream == NULL)
+		return -EINVAL;
+
+	ret = stream->error;
+	if ((ret == 0) && (stream->buf_len > 0)) {
+		if (stream->decrypt) {
+			DPRINTF("%s: Stream ends with incomplete chunk of %ld bytes\n", __FUNCTION__,
+					(unsigned long)stream->buf_len);
+			ret = -EINVAL;
+		}
+		else
+			ret = stream_process(stream, stream->buf, stream->buf_len);
+	}
+
+	if ((ret == 0) && !stream->decrypt && stream->ctx->index) {
+		unsigned char *data;
+		size_t size;
+
+		if ((data = chunk_index_serialize(&stream->index, &size)) == NULL)
+			ret = -ENOMEM;
+		else {
+			ret = stream->write(stream->opaque, data, size);
+			free(data);
+		}
+	}
+
+	if (ret == 0)
+		stream->ctx->checksum = stream->checksum;
+
+	DPRINTF("%s: Stream finished after %d chunks with code %d\n", __FUNCTION__, stream->id - 1, ret);
+
+	chunk_index_free(&stream->index);
+	free(stream->buf);
+	free(stream->out);
+	free(stream);
+	return ret;
+}
@@ -0,0 +1,468 @@
+/*
+ *  uring.c: Asynchronous file encryption and decryption using io_uring
+ *
+ *  Copyright (c) 2010-2011, Michal Novotny <mignov@gmail.com>
+ *  All rights reserved.
+ *
+ *  See COPYING for the license of this software
+ *
+ */
+
+#include "mincrypt.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#ifndef DISABLE_DEBUG
+#define DEBUG_URING
+#endif
+
+#ifdef DEBUG_URING
+#define DPRINTF(fmt, ...) \
+do { fprintf(stderr, "[mincrypt/uring       ] " fmt , ## __VA_ARGS__); } while (0)
+#else
+#define DPRINTF(fmt, ...) \
+do {} while(0)
+#endif
+
+#define	URING_DEPTH		8				/* number of chunks in flight */
+
+#define	SLOT_FREE		0
+#define	SLOT_READING		1
+#define	SLOT_READY		2
+#define	SLOT_WRITING		3
+
+typedef struct tUring {
+	int fd;
+	unsigned char *sq_ring;
+	unsigned char *cq_ring;
+	size_t sq_ring_size;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned to_submit;
+	int fixed;			/* buffers are registered */
+} tUring;
+
+/* Chunk being read, transformed or written */
+typedef struct tUringSlot {
+	int state;
+	int chunk;
+	unsigned char *in;
+	unsigned char *out;
+	size_t in_len;
+	size_t out_len;
+	uint64_t in_off;
+	uint64_t out_off;
+	size_t done;			/* bytes of the current read or write done */
+	struct iovec iov;		/* used if buffers are not registered */
+} tUringSlot;
+
+/*
+	Private function name:	uring_init
+	Since version:		0.0.5
+	Description:		This function is used to create the ring and map its submission and completion queues
+	Arguments:		@ring [ring]: ring to initialize
+				@entries [unsigned]: number of submission queue entries
+	Returns:		0 on success, -errno otherwise
+*/
+static int uring_init(tUring *ring, unsigned entries)
+{
+	struct io_uring_params p;
+	int ret;
+
+	memset(ring, 0, sizeof(tUring));
+	memset(&p, 0, sizeof(p));
+	ring->sq_ring = ring->cq_ring = MAP_FAILED;
+	ring->sqes = MAP_FAILED;
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0)
+		return -errno;
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sq_ring = (unsigned char *)mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ring = (unsigned char *)mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				ring->fd, IORING_OFF_SQES);
+	if ((ring->sq_ring == MAP_FAILED) || (ring->cq_ring == MAP_FAILED) || (ring->sqes == MAP_FAILED)) {
+		ret = -errno;
+		DPRINTF("%s: Cannot map the ring (%s)\n", __FUNCTION__, strerror(-ret));
+		return ret;
+	}
+
+	ring->sq_head = (unsigned *)(ring->sq_ring + p.sq_off.head);
+	ring->sq_tail = (unsigned *)(ring->sq_ring + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)(ring->sq_ring + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(ring->sq_ring + p.sq_off.array);
+	ring->cq_head = (unsigned *)(ring->cq_ring + p.cq_off.head);
+	ring->cq_tail = (unsigned *)(ring->cq_ring + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)(ring->cq_ring + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(ring->cq_ring + p.cq_off.cqes);
+
+	return 0;
+}
+
+/*
+	Private function name:	uring_free
+	Since version:		0.0.5
+	Description:		This function is used to unmap and close the ring
+	Arguments:		@ring [ring]: ring to free
+	Returns:		None
+*/
+static void uring_free(tUring *ring)
+{
+	if (ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring != MAP_FAILED)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring != MAP_FAILED)
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+}
+
+/*
+	Private function name:	uring_queue
+	Since version:		0.0.5
+	Description:		This function is used to queue the read or the write of the rest of the slot data. The queue is never full as there is at most one request per slot
+	Arguments:		@ring [ring]: ring to queue the request to
+				@slot [slot]: slot the request is for
+				@num [int]: number of the slot
+				@fd [int]: file descriptor to read from or write to
+	Returns:		None
+*/
+static void uring_queue(tUring *ring, tUringSlot *slot, int num, int fd)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail, i;
+	int write = (slot->state == SLOT_WRITING);
+
+	tail = *ring->sq_tail;
+	i = tail & *ring->sq_mask;
+	sqe = &ring->sqes[i];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	sqe->fd = fd;
+	sqe->user_data = num;
+	sqe->off = (write ? slot->out_off : slot->in_off) + slot->done;
+	if (ring->fixed) {
+		/* Registered buffers are the input and output buffers of the slots in turn */
+		sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->addr = (uint64_t)(uintptr_t)((write ? slot->out : slot->in) + slot->done);
+		sqe->len = (write ? slot->out_len : slot->in_len) - slot->done;
+		sqe->buf_index = 2 * num + write;
+	}
+	else {
+		slot->iov.iov_base = (write ? slot->out : slot->in) + slot->done;
+		slot->iov.iov_len = (write ? slot->out_len : slot->in_len) - slot->done;
+		sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+		sqe->addr = (uint64_t)(uintptr_t)&slot->iov;
+		sqe->len = 1;
+	}
+
+	ring->sq_array[i] = i;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit++;
+}
+
+/*
+	Private function name:	uring_enter
+	Since version:		0.0.5
+	Description:		This function is used to submit the queued requests and to wait for completions
+	Arguments:		@ring [ring]: ring to submit the requests of
+				@wait [int]: number of completions to wait for
+	Returns:		0 on success, -errno otherwise
+*/
+static int uring_enter(tUring *ring, unsigned wait)
+{
+	int rc;
+
+	while ((ring->to_submit > 0) || (wait > 0)) {
+		rc = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		ring->to_submit -= rc;
+		wait = 0;
+	}
+
+	return 0;
+}
+
+/*
+	Private function name:	uring_transform
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the chunk read to the slot to its output buffer
+	Arguments:		@ctx [context]: context to be used for the processing
+				@slot [slot]: slot with the chunk read
+				@e [entry]: index entry of the chunk
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+				@crc [uint32_t]: output value for the CRC-32 register of the plain chunk
+	Returns:		0 on success, error code otherwise
+*/
+static int uring_transform(mincrypt_ctx_t *ctx, tUringSlot *slot, tChunkIndexEntry *e, int decrypt, uint32_t *crc)
+{
+	size_t size = 0;
+	int ret;
+
+	if (decrypt) {
+		/* Layout may come from the chunk index so make sure it matches the chunk */
+		if ((ret = chunk_check_span(slot->in, slot->in_len, slot->out_len)) != 0)
+			return ret;
+
+		ret = mincrypt_ctx_decrypt_into(ctx, slot->in, slot->in_len, e->id, slot->out, slot->out_len, &size, NULL);
+		if ((ret == 0) && (size != slot->out_len))
+			ret = -EINVAL;
+		*crc = CHUNK_PLAIN_CRC(slot->in);
+	}
+	else {
+		ret = mincrypt_ctx_encrypt_into(ctx, slot->in, slot->in_len, e->id, slot->out, slot->out_len, &size);
+		*crc = CHUNK_PLAIN_CRC(slot->out);
+	}
+
+	return ret;
+}
+
+/*
+	Function name:		mincrypt_uring_process_fd
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the whole input file using io_uring. Up to URING_DEPTH chunks are read and written asynchronously into registered buffers while the chunks read already are transformed in order, so the disk and the CPU are busy at the same time. The layout of the chunks is known in advance, from the size of the input for encryption and from the chunk headers or the chunk index for decryption
+	Arguments:		@ctx [context]: context to be used for the processing
+				@fd [int]: input file descriptor
+				@fdOut [int]: output file descriptor
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+				@total [uint64_t]: output variable for the number of bytes of plain data, may be NULL
+	Returns:		0 for no error, -ENOTSUP if io_uring is not available or the files are not seekable and read or write mode has to be used, -errno otherwise
+*/
+int mincrypt_uring_process_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, uint64_t *total)
+{
+	tUringSlot slots[URING_DEPTH];
+	struct iovec iovs[2 * URING_DEPTH];
+	struct io_uring_cqe *cqe;
+	tChunkIndexEntry *e;
+	tChunkIndex idx;
+	tUring ring;
+	struct stat st;
+	tUringSlot *slot;
+	unsigned char *bufs = NULL, *index = NULL;
+	size_t in_max = 0, out_max = 0, index_size = 0, size;
+	unsigned head, inflight = 0;
+	int i, next_read = 0, next_proc = 0, written = 0, rc, ret = 0;
+	uint64_t t;
+	uint32_t crc;
+
+	if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size == 0) || (lseek(fdOut, 0, SEEK_CUR) < 0))
+		return -ENOTSUP;
+
+	if (decrypt) {
+		if ((ret = chunk_index_scan(fd, &idx)) != 0)
+			return (ret == -ESPIPE) ? -ENOTSUP : ret;
+	}
+	else {
+		if ((ret = chunk_index_plan(ctx, &idx, st.st_size)) != 0)
+			return ret;
+		if (ctx->index && ((index = chunk_index_serialize(&idx, &index_size)) == NULL)) {
+			chunk_index_free(&idx);
+			return -ENOMEM;
+		}
+	}
+
+	if (idx.num == 0) {
+		chunk_index_free(&idx);
+		free(index);
+		return -EINVAL;
+	}
+
+	if ((ret = uring_init(&ring, URING_DEPTH)) != 0) {
+		DPRINTF("%s: Cannot create io_uring (%s), falling back to read mode\n", __FUNCTION__, strerror(-ret));
+		uring_free(&ring);
+		chunk_index_free(&idx);
+		free(index);
+		return -ENOTSUP;
+	}
+
+	for (i = 0; i < idx.num; i++) {
+		e = &idx.entries[i];
+		size = ((i + 1 < idx.num) ? e[1].offset : idx.offset) - e->offset;
+		if (size > in_max)
+			in_max = size;
+		if (e->size > out_max)
+			out_max = e->size;
+	}
+
+	/* For encryption the encrypted chunk is the output */
+	if (!decrypt) {
+		size = in_max;
+		in_max = out_max;
+		out_max = size;
+	}
+
+	if (posix_memalign((void **)&bufs, 4096, URING_DEPTH * (in_max + out_max)) != 0) {
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+	STATS_ADD(ctx, allocations, 1);
+
+	for (i = 0; i < URING_DEPTH; i++) {
+		memset(&slots[i], 0, sizeof(tUringSlot));
+		slots[i].state = SLOT_FREE;
+		slots[i].in = bufs + i * (in_max + out_max);
+		slots[i].out = slots[i].in + in_max;
+
+		iovs[2 * i].iov_base = slots[i].in;
+		iovs[2 * i].iov_len = in_max;
+		iovs[2 * i + 1].iov_base = slots[i].out;
+		iovs[2 * i + 1].iov_len = out_max;
+	}
+
+	/* Registration may fail e.g. because of the locked memory limit, plain vectored requests are used then */
+	ring.fixed = (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, iovs, 2 * URING_DEPTH) == 0);
+
+	DPRINTF("%s: %s %d chunks, %sregistered buffers\n", __FUNCTION__, decrypt ? "Decrypting" : "Encrypting",
+		idx.num, ring.fixed ? "" : "no ");
+
+	crc32_gentab();
+	ctx->checksum = 0;
+
+	while ((written < idx.num) || (inflight > 0)) {
+		/* Read the next chunks to the free slots, chunk n always uses slot n % URING_DEPTH */
+		while ((ret == 0) && (next_read < idx.num) && (slots[next_read % URING_DEPTH].state == SLOT_FREE)) {
+			slot = &slots[next_read % URING_DEPTH];
+			e = &idx.entries[next_read];
+
+			slot->chunk = next_read;
+			slot->done = 0;
+			slot->state = SLOT_READING;
+			if (decrypt) {
+				slot->in_off = e->offset;
+				slot->in_len = ((next_read + 1 < idx.num) ? e[1].offset : idx.offset) - e->offset;
+				slot->out_off = e->plain_offset;
+				slot->out_len = e->size;
+			}
+			else {
+				slot->in_off = e->plain_offset;
+				slot->in_len = e->size;
+				slot->out_off = e->offset;
+				slot->out_len = ((next_read + 1 < idx.num) ? e[1].offset : idx.offset) - e->offset;
+			}
+
+			uring_queue(&ring, slot, next_read % URING_DEPTH, fd);
+			inflight++;
+			next_read++;
+		}
+
+		/* Transform the chunks in order as soon as they are read, the writes are queued right away */
+		while ((ret == 0) && (next_proc < idx.num) && (slots[next_proc % URING_DEPTH].state == SLOT_READY)) {
+			slot = &slots[next_proc % URING_DEPTH];
+			if ((ret = uring_transform(ctx, slot, &idx.entries[next_proc], decrypt, &crc)) != 0)
+				break;
+
+			ctx->checksum = crc32_combine(ctx->checksum, crc, idx.entries[next_proc].size);
+
+			slot->done = 0;
+			slot->state = SLOT_WRITING;
+			uring_queue(&ring, slot, next_proc % URING_DEPTH, fdOut);
+			inflight++;
+			next_proc++;
+		}
+
+		if ((ret != 0) && (inflight == 0))
+			break;
+
+		/* Some chunk is always being read or written here as all the chunks read were transformed */
+		t = STATS_START(ctx);
+		if ((rc = uring_enter(&ring, 1)) != 0) {
+			DPRINTF("%s: Cannot submit requests (%s)\n", __FUNCTION__, strerror(-rc));
+			ret = rc;
+			break;
+		}
+		STATS_STOP(ctx, ns_io, t);
+
+		head = *ring.cq_head;
+		while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &ring.cqes[head & *ring.cq_mask];
+			slot = &slots[cqe->user_data];
+			inflight--;
+			head++;
+
+			if (cqe->res <= 0) {
+				/* Zero means the input file has been truncated meanwhile */
+				DPRINTF("%s: %s of chunk #%d failed with code %d\n", __FUNCTION__,
+					(slot->state == SLOT_WRITING) ? "Write" : "Read", slot->chunk + 1, cqe->res);
+				if (ret == 0)
+					ret = (cqe->res < 0) ? cqe->res : -EIO;
+				continue;
+			}
+
+			slot->done += cqe->res;
+			if (slot->done < ((slot->state == SLOT_WRITING) ? slot->out_len : slot->in_len)) {
+				/* Short read or write, queue the rest */
+				if (ret == 0) {
+					uring_queue(&ring, slot, cqe->user_data, (slot->state == SLOT_WRITING) ? fdOut : fd);
+					inflight++;
+				}
+			}
+			else
+			if (slot->state == SLOT_READING)
+				slot->state = SLOT_READY;
+			else {
+				slot->state = SLOT_FREE;
+				written++;
+			}
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	if ((ret == 0) && (index != NULL))
+		ret = pwrite_full(fdOut, index, index_size, idx.offset);
+
+	if ((ret == 0) && (total != NULL))
+		*total = idx.plain_offset;
+
+	DPRINTF("%s: Processing done with code %d\n", __FUNCTION__, ret);
+
+cleanup:
+	uring_free(&ring);
+	free(bufs);
+	free(index);
+	chunk_index_free(&idx);
+
+	return ret;
+}
+#else
+/*
+	Function name:		mincrypt_uring_process_fd
+	Since version:		0.0.5
+	Description:		This function is used to encrypt or decrypt the whole input file using io_uring, not supported by this build
+	Arguments:		@ctx [context]: context to be used for the processing
+				@fd [int]: input file descriptor
+				@fdOut [int]: output file descriptor
+				@decrypt [int]: boolean whether to encrypt or decrypt (0 = encrypt, 1 = decrypt)
+				@total [uint64_t]: output variable for the number of bytes of plain data, may be NULL
+	Returns:		-ENOTSUP
+*/
+int mincrypt_uring_process_fd(mincrypt_ctx_t *ctx, int fd, int fdOut, int decrypt, uint64_t *total)
+{
+	return -ENOTSUP;
+}
+#endif
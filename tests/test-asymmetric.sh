@@ -51,6 +51,8 @@ echo "All symmetric algorithm tests passed"
 if [ "x$SKIP_KEYGEN" != "x1" ]; then
 	../src/mincrypt --key-size $KEYSIZE --salt $SALT1 --password $PASSWORD1 --key-file $KEYFILE_PREFIX_1
 	../src/mincrypt --key-size $KEYSIZE --salt $SALT1 --password $PASSWORD2 --key-file $KEYFILE_PREFIX_2
+	# Keys are seeded by current time so make sure the same credentials generate different key
+	sleep 1
 	../src/mincrypt --key-size $KEYSIZE --salt $SALT1 --password $PASSWORD1 --key-file $KEYFILE_PREFIX_1X
 	echo "All 3 keys generated"
 else
@@ -20,6 +20,10 @@
 	$out = mincrypt_decrypt($in, $size);
 	$lowlevel_ok = ($out == $orig);
 
+	/* Chunk header claiming more data than the block holds has to be rejected */
+	mincrypt_reset_id();
+	$lowlevel_trunc = (mincrypt_decrypt(substr($in, 0, $size - 16), $size - 16) === false);
+
 	mincrypt_set_password($password2, $salt, $mult);
 	$out = mincrypt_decrypt($in, $size);
 
@@ -77,7 +81,7 @@
 	unlink('tmp2');
 	unlink('tmp3');
 
-	if ((!($highlevel_ok && $highlevel_fail && $lowlevel_ok && $lowlevel_fail && $lowlevel_file))
+	if ((!($highlevel_ok && $highlevel_fail && $lowlevel_ok && $lowlevel_fail && $lowlevel_trunc && $lowlevel_file))
 		|| (is_string($highlevel_fail) || is_string($highlevel_ok))){
 		echo "High-level API test: ".($highlevel_ok ?
 			(is_string($highlevel_ok) ? $highlevel_ok : "Success") : "Failed")."\n";
@@ -85,6 +89,7 @@
 			(is_string($highlevel_fail) ? $highlevel_fail : "Success") : "Failed")."\n";
 		echo "Low-level API test: ".($lowlevel_ok ? "Success" : "Failed")."\n";
 		echo "Low-level API fail test: ".($lowlevel_fail ? "Success" : "Failed")."\n";
+		echo "Low-level API truncated chunk test: ".($lowlevel_trunc ? "Success" : "Failed")."\n";
 		echo "Low-level file API test: ".($lowlevel_file ? "Success" : "Failed")."\n";
 
 		bail("At least one of tests failed\n");
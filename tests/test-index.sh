@@ -0,0 +1,76 @@
+#!/bin/bash
+
+SIZEKB=1000
+SALT="test"
+PASSWORD="password"
+THREADS=4
+
+bail()
+{
+	local msg="$1"
+	echo "ERROR: $msg !"
+	rm -f test test.enc test.enc2 test.dec test.part
+	exit 1
+}
+
+dd if=/dev/urandom of=test bs=1K count=$SIZEKB
+
+../src/mincrypt --input-file=test --output-file=test.enc --salt=$SALT --password=$PASSWORD --index
+if [ "x$?" != "x0" ]; then
+	bail "Test for encryption with chunk index failed"
+fi
+
+../src/mincrypt --input-file=test --output-file=test.enc2 --salt=$SALT --password=$PASSWORD --index --threads=$THREADS
+cmp test.enc test.enc2 >/dev/null
+if [ "x$?" != "x0" ]; then
+	bail "Check for identical chunk index of single and multithreaded encryption failed"
+fi
+
+for threads in 1 $THREADS; do
+	../src/mincrypt --input-file=test.enc --output-file=test.dec --salt=$SALT --password=$PASSWORD --decrypt --threads=$threads
+	cmp test test.dec >/dev/null
+	if [ "x$?" != "x0" ]; then
+		bail "Check for decryption of file with chunk index using $threads threads failed"
+	fi
+done
+
+# Ranges within a chunk, across chunk boundaries and past the end of data
+for range in 0:1 1000:100 131000:200000 500000:1 1023990:100 0:1024000; do
+	OFF=${range%:*}
+	LEN=${range#*:}
+	../src/mincrypt --input-file=test.enc --output-file=test.dec --salt=$SALT --password=$PASSWORD --decrypt \
+		--offset=$OFF --length=$LEN
+	if [ "x$?" != "x0" ]; then
+		bail "Test for decryption of $LEN bytes at offset $OFF failed"
+	fi
+
+	tail -c +$(($OFF + 1)) test | head -c $LEN > test.part
+	cmp test.part test.dec >/dev/null
+	if [ "x$?" != "x0" ]; then
+		bail "Check for decryption of $LEN bytes at offset $OFF failed"
+	fi
+done
+
+../src/mincrypt --input-file=test.enc --output-file=test.dec --salt=$SALT --password=passwore --decrypt --offset=1000 --length=100
+if [ "x$?" == "x0" ]; then
+	bail "Test for range decryption with invalid password failed"
+fi
+
+# Shrink the first chunk in the index by moving the second chunk offset (big-endian) right after its header
+cp test.enc test.enc2
+SIZE=$(stat -c %s test.enc2)
+IDXOFF=$((16#$(od -An -tx1 -j $(($SIZE - 12)) -N8 test.enc2 | tr -d ' \n')))
+printf '\x00\x00\x00\x00\x00\x00\x00\x64' | dd of=test.enc2 bs=1 seek=$(($IDXOFF + 32)) conv=notrunc 2>/dev/null
+../src/mincrypt --input-file=test.enc2 --output-file=test.dec --salt=$SALT --password=$PASSWORD --decrypt --offset=0 --length=100
+if [ "x$?" == "x0" ]; then
+	bail "Test for range decryption with corrupted chunk index failed"
+fi
+
+../src/mincrypt --input-file=test.enc2 --output-file=test.dec --salt=$SALT --password=$PASSWORD --decrypt --threads=$THREADS
+if [ "x$?" == "x0" ]; then
+	bail "Test for decryption with corrupted chunk index using $THREADS threads failed"
+fi
+
+echo "All chunk index tests passed successfully"
+rm -f test test.enc test.enc2 test.dec test.part
+exit 0
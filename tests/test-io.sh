@@ -0,0 +1,86 @@
+#!/bin/bash
+
+SIZEKB=1000
+SALT="test"
+PASSWORD="password"
+THREADS=4
+
+bail()
+{
+	local msg="$1"
+	echo "ERROR: $msg !"
+	rm -f test test.enc test.enc2 test.dec
+	exit 1
+}
+
+dd if=/dev/urandom of=test bs=1K count=$SIZEKB
+
+../src/mincrypt --input-file=test --output-file=test.enc --salt=$SALT --password=$PASSWORD --index
+if [ "x$?" != "x0" ]; then
+	bail "Test for encryption using read mode failed"
+fi
+
+for io in mmap mmap-rw uring; do
+	for threads in 1 $THREADS; do
+		../src/mincrypt --input-file=test --output-file=test.enc2 --salt=$SALT --password=$PASSWORD --index \
+			--io=$io --threads=$threads
+		cmp test.enc test.enc2 >/dev/null
+		if [ "x$?" != "x0" ]; then
+			bail "Check for identical output of read and $io mode encryption using $threads threads failed"
+		fi
+
+		../src/mincrypt --input-file=test.enc --output-file=test.dec --salt=$SALT --password=$PASSWORD --decrypt \
+			--io=$io --threads=$threads
+		cmp test test.dec >/dev/null
+		if [ "x$?" != "x0" ]; then
+			bail "Check for decryption using $io mode and $threads threads failed"
+		fi
+	done
+done
+
+../src/mincrypt --input-file=test --output-file=test.enc2 --salt=$SALT --password=$PASSWORD --index --direct
+cmp test.enc test.enc2 >/dev/null
+if [ "x$?" != "x0" ]; then
+	bail "Check for identical output of encryption using direct I/O failed"
+fi
+
+../src/mincrypt --input-file=test.enc --output-file=test.dec --salt=$SALT --password=$PASSWORD --decrypt --direct
+cmp test test.dec >/dev/null
+if [ "x$?" != "x0" ]; then
+	bail "Check for decryption using direct I/O failed"
+fi
+
+for size in 4096 1000000 auto; do
+	../src/mincrypt --input-file=test --output-file=test.enc2 --salt=$SALT --password=$PASSWORD --chunk-size=$size
+	if [ "x$?" != "x0" ]; then
+		bail "Test for encryption using chunk size $size failed"
+	fi
+
+	../src/mincrypt --input-file=test.enc2 --output-file=test.dec --salt=$SALT --password=$PASSWORD --decrypt --threads=$THREADS
+	cmp test test.dec >/dev/null
+	if [ "x$?" != "x0" ]; then
+		bail "Check for decryption of file using chunk size $size failed"
+	fi
+done
+
+cat test | ../src/mincrypt --input-file=- --output-file=- --salt=$SALT --password=$PASSWORD --index > test.enc2
+cmp test.enc test.enc2 >/dev/null
+if [ "x$?" != "x0" ]; then
+	bail "Check for identical output of encryption from standard input to standard output failed"
+fi
+
+cat test.enc | ../src/mincrypt --input-file=- --output-file=- --salt=$SALT --password=$PASSWORD --decrypt \
+	--threads=$THREADS > test.dec
+cmp test test.dec >/dev/null
+if [ "x$?" != "x0" ]; then
+	bail "Check for decryption from standard input to standard output failed"
+fi
+
+../src/mincrypt --input-file=test.enc --output-file=test.dec --salt=$SALT --password=passwore --decrypt --io=mmap-rw
+if [ "x$?" == "x0" ]; then
+	bail "Test for mmap-rw mode decryption with invalid password failed"
+fi
+
+echo "All I/O mode tests passed successfully"
+rm -f test test.enc test.enc2 test.dec
+exit 0
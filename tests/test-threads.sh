@@ -0,0 +1,54 @@
+#!/bin/bash
+
+SIZEMB=16
+SALT="test"
+PASSWORD="password"
+THREADS=4
+
+bail()
+{
+	local msg="$1"
+	echo "ERROR: $msg !"
+	rm -f test test.enc test.enc2 test.dec
+	exit 1
+}
+
+dd if=/dev/urandom of=test bs=1M count=$SIZEMB
+
+../src/mincrypt --input-file=test --output-file=test.enc --salt=$SALT --password=$PASSWORD
+../src/mincrypt --input-file=test --output-file=test.enc2 --salt=$SALT --password=$PASSWORD --threads=$THREADS
+if [ "x$?" != "x0" ]; then
+	bail "Test for encryption using $THREADS threads failed"
+fi
+
+cmp test.enc test.enc2 >/dev/null
+if [ "x$?" != "x0" ]; then
+	bail "Check for identical output of single and multithreaded encryption failed"
+fi
+
+../src/mincrypt --input-file=test.enc --output-file=test.dec --salt=$SALT --password=$PASSWORD --decrypt --threads=$THREADS
+if [ "x$?" != "x0" ]; then
+	bail "Test for decryption using $THREADS threads failed"
+fi
+
+diff -up test test.dec >/dev/null
+if [ "x$?" != "x0" ]; then
+	bail "Check for multithreaded decryption failed"
+fi
+
+../src/mincrypt --input-file=test.enc --output-file=test.dec --salt=$SALT --password=passwore --decrypt --threads=$THREADS
+if [ "x$?" == "x0" ]; then
+	bail "Test for multithreaded decryption with invalid password failed"
+fi
+
+CRC1=$(../src/mincrypt --input-file=test --checksum --threads=$THREADS | awk '/CRC-32/ { print $NF }')
+CRC2=$(../src/mincrypt --input-file=test --checksum --threads=1 | awk '/CRC-32/ { print $NF }')
+CRC3=$(../src/mincrypt --input-file=test.enc2 --output-file=test.dec --salt=$SALT --password=$PASSWORD --decrypt \
+	--threads=$THREADS --checksum | awk '/CRC-32/ { print $NF }')
+if [ -z "$CRC1" ] || [ "x$CRC1" != "x$CRC2" ] || [ "x$CRC1" != "x$CRC3" ]; then
+	bail "Check for identical multithreaded, single threaded and decryption checksums failed"
+fi
+
+echo "All multithreaded tests passed successfully"
+rm -f test test.enc test.enc2 test.dec
+exit 0